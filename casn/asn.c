@@ -1,4 +1,5 @@
 #include <casn/asn.h>
+#include <sys/mman.h>
 
 static void asn_crypto_set_nonce (asn_crypto_state_t * cs, u8 * self_public_key, u8 * peer_public_key,
 				  u8 * nonce)
@@ -50,66 +51,104 @@ asn_crypto_create_keys (asn_crypto_public_keys_t * public, asn_crypto_private_ke
   ASSERT (asn_crypto_is_valid_self_signed_key (&ssk, public));
 }
 
-always_inline u8 *
-asn_user_key_to_mem (asn_main_t * am, asn_rx_or_tx_t rt, uword k)
+static void
+asn_user_key_table_insert (asn_user_key_table_t * t, u64 fingerprint, uword user_ref_as_uword)
+{
+  asn_user_key_table_slot_t * s;
+  uword i, mask = vec_len (t->slots) - 1;
+
+  i = asn_user_key_table_slot_index (t, fingerprint);
+  while (t->slots[i].user_ref_as_uword != ~0)
+    i = (i + 1) & mask;
+
+  s = t->slots + i;
+  s->key_fingerprint = fingerprint;
+  s->user_ref_as_uword = user_ref_as_uword;
+  t->n_elts++;
+}
+
+/* Size table to hold at least given number of elements at load factor at most 1/2. */
+void asn_user_key_table_resize (asn_user_key_table_t * t, uword n_elts)
 {
-  asn_user_t * u;
-  u8 * m;
-  if (k % 2)
+  asn_user_key_table_slot_t * old_slots = t->slots, * s;
+  uword log2_n_slots = max_log2 (clib_max (2 * n_elts, 16));
+
+  if (log2_n_slots <= t->log2_n_slots)
+    return;
+
+  if (! t->hash_multiplier)
     {
-      u = asn_user_by_ref_as_uword (k / 2);
-      m = u->crypto_keys.public.encrypt_key;
+      crypto_random_bytes ((u8 *) &t->hash_multiplier, sizeof (t->hash_multiplier));
+      t->hash_multiplier |= 1;
     }
-  else
-    m = uword_to_pointer (k, u8 *);
 
-  return m;
+  t->slots = 0;
+  vec_resize_aligned (t->slots, (uword) 1 << log2_n_slots, CLIB_CACHE_LINE_BYTES);
+  memset (t->slots, ~0, vec_bytes (t->slots));
+  t->log2_n_slots = log2_n_slots;
+  t->n_elts = 0;
+
+  vec_foreach (s, old_slots)
+    {
+      if (s->user_ref_as_uword != ~0)
+	asn_user_key_table_insert (t, s->key_fingerprint, s->user_ref_as_uword);
+    }
+
+  vec_free (old_slots);
 }
 
-static uword
-asn_user_key_sum (hash_t * h, uword key, uword n_key_bytes)
+void asn_user_key_table_set (asn_user_key_table_t * t, asn_user_t * au)
 {
-  asn_main_t * am = uword_to_pointer (h->user &~ 1, asn_main_t *);
-  asn_rx_or_tx_t rt = h->user & 1;
-  u8 * k = asn_user_key_to_mem (am, rt, key);
-  ASSERT (n_key_bytes <= STRUCT_SIZE_OF (asn_user_t, crypto_keys.public.encrypt_key));
-  return hash_memory (k, n_key_bytes, /* hash_seed */ 0);
-}
+  asn_user_key_table_slot_t * s;
+  asn_user_ref_t r;
 
-static uword
-asn_user_key_sum_full (hash_t * h, uword key)
-{ return asn_user_key_sum (h, key, STRUCT_SIZE_OF (asn_user_t, crypto_keys.public.encrypt_key)); }
+  r.type_index = au->user_type_index;
+  r.user_index = au->index;
 
-static uword
-asn_user_key_sum_7 (hash_t * h, uword key)
-{ return asn_user_key_sum (h, key, 7); }
+  s = asn_user_key_table_get (t, au->crypto_keys.public.encrypt_key);
+  if (s)
+    {
+      s->user_ref_as_uword = asn_user_ref_as_uword (&r);
+      return;
+    }
 
-static uword
-asn_user_key_sum_8 (hash_t * h, uword key)
-{ return asn_user_key_sum (h, key, 8); }
+  if (2 * (t->n_elts + 1) > vec_len (t->slots))
+    asn_user_key_table_resize (t, t->n_elts + 1);
 
-static uword
-asn_user_key_equal (hash_t * h, uword key1, uword key2, uword n_key_bytes)
-{
-  asn_main_t * am = uword_to_pointer (h->user &~ 1, asn_main_t *);
-  asn_rx_or_tx_t rt = h->user & 1;
-  u8 * k1 = asn_user_key_to_mem (am, rt, key1);
-  u8 * k2 = asn_user_key_to_mem (am, rt, key2);
-  ASSERT (n_key_bytes <= STRUCT_SIZE_OF (asn_user_t, crypto_keys.public.encrypt_key));
-  return 0 == memcmp (k1, k2, n_key_bytes);
+  asn_user_key_table_insert (t, asn_user_key_fingerprint (au->crypto_keys.public.encrypt_key),
+			     asn_user_ref_as_uword (&r));
 }
 
-static uword
-asn_user_key_equal_full (hash_t * h, uword key1, uword key2)
-{ return asn_user_key_equal (h, key1, key2, STRUCT_SIZE_OF (asn_user_t, crypto_keys.public.encrypt_key)); }
+/* Empties slot and shifts back later slots of its probe run so lookups need no tombstones. */
+void asn_user_key_table_unset (asn_user_key_table_t * t, asn_user_key_table_slot_t * s)
+{
+  uword i, j, k, mask = vec_len (t->slots) - 1;
 
-static uword
-asn_user_key_equal_7 (hash_t * h, uword key1, uword key2)
-{ return asn_user_key_equal (h, key1, key2, 7); }
+  i = j = s - t->slots;
+  while (1)
+    {
+      j = (j + 1) & mask;
+      if (t->slots[j].user_ref_as_uword == ~0)
+	break;
 
-static uword
-asn_user_key_equal_8 (hash_t * h, uword key1, uword key2)
-{ return asn_user_key_equal (h, key1, key2, 8); }
+      /* Slot j stays unless its home slot k is outside cyclic range (i, j]. */
+      k = asn_user_key_table_slot_index (t, t->slots[j].key_fingerprint);
+      if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+	continue;
+
+      t->slots[i] = t->slots[j];
+      i = j;
+    }
+
+  t->slots[i].user_ref_as_uword = ~0;
+  t->n_elts--;
+}
+
+void asn_user_key_table_free (asn_user_key_table_t * t)
+{
+  vec_free (t->slots);
+  memset (t, 0, sizeof (t[0]));
+}
 
 asn_user_t *
 asn_update_peer_user (asn_main_t * am, asn_rx_or_tx_t rt, u32 user_type_index, u8 * encrypt_key, u8 * auth_key)
@@ -129,99 +168,300 @@ asn_update_peer_user (asn_main_t * am, asn_rx_or_tx_t rt, u32 user_type_index, u
   return au;
 }
 
-static void asn_user_hash_value_free (uword v)
+/* Deleted flag in element is ignored so deleted elements keep their place in run order. */
+always_inline int
+asn_user_key_prefix_index_elt_compare (asn_user_key_prefix_index_elt_t * e, u64 key_prefix, uword user_ref_as_uword)
 {
-  asn_user_hash_value_t hv;
-  hv.as_uword = v;
-  if (! hv.is_inline)
-    vec_free (hv.value_vector);
+  uword r = e->user_ref_as_uword &~ ASN_USER_KEY_PREFIX_INDEX_DELETED;
+  if (e->key_prefix != key_prefix)
+    return e->key_prefix < key_prefix ? -1 : +1;
+  if (r != user_ref_as_uword)
+    return r < user_ref_as_uword ? -1 : +1;
+  return 0;
 }
 
-static void asn_user_hash_value_update (asn_user_hash_value_t * hv, uword value_to_add)
+static int asn_user_key_prefix_index_elt_sort (asn_user_key_prefix_index_elt_t * e1, asn_user_key_prefix_index_elt_t * e2)
 {
-  uword * v = 0;
-  if (hv->is_inline)
-    vec_add1 (v, hv->inline_value);
-  else
-    v = hv->value_vector;
+  return asn_user_key_prefix_index_elt_compare
+    (e1, e2->key_prefix, e2->user_ref_as_uword &~ ASN_USER_KEY_PREFIX_INDEX_DELETED);
+}
 
-  vec_add1 (v, value_to_add);
-  hv->value_vector = v;
+/* Index of first element not less than given key prefix and reference. */
+static uword
+asn_user_key_prefix_index_lower_bound (asn_user_key_prefix_index_elt_t * v, u64 key_prefix, uword user_ref_as_uword)
+{
+  uword lo = 0, hi = vec_len (v), i;
+  while (lo < hi)
+    {
+      i = lo + (hi - lo) / 2;
+      if (asn_user_key_prefix_index_elt_compare (v + i, key_prefix, user_ref_as_uword) < 0)
+	lo = i + 1;
+      else
+	hi = i;
+    }
+  return lo;
 }
 
-static void asn_user_hash_by_public_key (asn_main_t * am, asn_rx_or_tx_t rt, asn_user_t * au)
+/* Element with given key prefix and reference or zero. */
+static asn_user_key_prefix_index_elt_t *
+asn_user_key_prefix_index_find (asn_user_key_prefix_index_elt_t * v, u64 key_prefix, uword user_ref_as_uword)
 {
-  uword k, * p;
-  asn_user_hash_value_t hv;
-  asn_user_ref_t r;
-  asn_crypto_keys_t * ck;
-  uword r_as_uword;
+  uword i = asn_user_key_prefix_index_lower_bound (v, key_prefix, user_ref_as_uword);
+  return i < vec_len (v) && ! asn_user_key_prefix_index_elt_compare (v + i, key_prefix, user_ref_as_uword) ? v + i : 0;
+}
 
-  ck = &au->crypto_keys;
+/* Run element (deleted or not) with given key prefix and reference or zero.
+   Each key prefix and reference is in at most one run. */
+static asn_user_key_prefix_index_elt_t *
+asn_user_key_prefix_index_find_in_runs (asn_user_key_prefix_index_t * x, u64 key_prefix, uword user_ref_as_uword)
+{
+  asn_user_key_prefix_index_elt_t ** r, * e;
+  vec_foreach (r, x->runs)
+    {
+      if ((e = asn_user_key_prefix_index_find (r[0], key_prefix, user_ref_as_uword)))
+	return e;
+    }
+  return 0;
+}
+
+/* Merge sorted vector V (disjoint from S) into S; merges from end in place. */
+static asn_user_key_prefix_index_elt_t *
+asn_user_key_prefix_index_merge (asn_user_key_prefix_index_elt_t * s, asn_user_key_prefix_index_elt_t * v)
+{
+  word i, j, k;
 
-  if (! am->user_ref_by_public_encrypt_key[rt])
-    {
-      am->user_ref_by_public_encrypt_key[rt]
-	= hash_create2 (/* elts */ 0,
-			/* user */ pointer_to_uword (am) | rt,
-			/* value_bytes */ sizeof (uword),
-			asn_user_key_sum_full,
-			asn_user_key_equal_full,
-			/* format pair/arg */
-			0, 0);
-      am->user_ref_by_public_encrypt_key_first_7_bytes[rt]
-	= hash_create2 (/* elts */ 0,
-			/* user */ pointer_to_uword (am) | rt,
-			/* value_bytes */ sizeof (asn_user_hash_value_t),
-			asn_user_key_sum_7,
-			asn_user_key_equal_7,
-			/* format pair/arg */
-			0, 0);
-      am->user_ref_by_public_encrypt_key_first_8_bytes[rt]
-	= hash_create2 (/* elts */ 0,
-			/* user */ pointer_to_uword (am) | rt,
-			/* value_bytes */ sizeof (asn_user_hash_value_t),
-			asn_user_key_sum_8,
-			asn_user_key_equal_8,
-			/* format pair/arg */
-			0, 0);
+  i = vec_len (s) - 1;
+  j = vec_len (v) - 1;
+  vec_resize (s, vec_len (v));
+  for (k = vec_len (s) - 1; j >= 0; k--)
+    {
+      if (i >= 0 && asn_user_key_prefix_index_elt_sort (s + i, v + j) > 0)
+	s[k] = s[i--];
+      else
+	s[k] = v[j--];
     }
+  return s;
+}
 
-  r.type_index = au->user_type_index;
-  r.user_index = au->index;
-  r_as_uword = asn_user_ref_as_uword (&r);
+/* Adds sorted vector V as newest run (index owns V) and merges newest runs
+   until each run is at least twice as long as the next. */
+static void
+asn_user_key_prefix_index_add_run (asn_user_key_prefix_index_t * x, asn_user_key_prefix_index_elt_t * v)
+{
+  uword n;
 
-  k = 1 + 2*r_as_uword;
+  if (vec_len (v) == 0)
+    {
+      vec_free (v);
+      return;
+    }
 
-  hash_set (am->user_ref_by_public_encrypt_key[rt], k, r_as_uword);
+  x->n_run_elts += vec_len (v);
+  vec_add1 (x->runs, v);
+  while ((n = vec_len (x->runs)) >= 2
+	 && vec_len (x->runs[n - 2]) < 2 * vec_len (x->runs[n - 1]))
+    {
+      x->runs[n - 2] = asn_user_key_prefix_index_merge (x->runs[n - 2], x->runs[n - 1]);
+      vec_free (x->runs[n - 1]);
+      vec_set_len (x->runs, n - 1);
+    }
+}
 
-  p = hash_get (am->user_ref_by_public_encrypt_key_first_7_bytes[rt], k);
-  if (! p)
+/* Drops deleted elements from all runs and rebuilds run sizes. */
+static void
+asn_user_key_prefix_index_compact (asn_user_key_prefix_index_t * x)
+{
+  asn_user_key_prefix_index_elt_t ** runs = x->runs, ** r;
+  uword i, j;
+
+  x->runs = 0;
+  x->n_run_elts = x->n_deleted_run_elts = 0;
+  vec_foreach (r, runs)
     {
-      hv.is_inline = 1;
-      hv.inline_value = r_as_uword;
-      hash_set (am->user_ref_by_public_encrypt_key_first_7_bytes[rt], k, hv.as_uword);
+      for (i = j = 0; i < vec_len (r[0]); i++)
+	if (! (r[0][i].user_ref_as_uword & ASN_USER_KEY_PREFIX_INDEX_DELETED))
+	  r[0][j++] = r[0][i];
+      vec_set_len (r[0], j);
+      asn_user_key_prefix_index_add_run (x, r[0]);
     }
-  else
+  vec_free (runs);
+}
+
+/* Returns 1 if element is already in index; deleted run element is brought back. */
+static uword
+asn_user_key_prefix_index_undelete (asn_user_key_prefix_index_t * x, u64 key_prefix, uword user_ref_as_uword)
+{
+  asn_user_key_prefix_index_elt_t * e = asn_user_key_prefix_index_find_in_runs (x, key_prefix, user_ref_as_uword);
+
+  if (! e)
+    return asn_user_key_prefix_index_find (x->recent, key_prefix, user_ref_as_uword) != 0;
+
+  if (e->user_ref_as_uword & ASN_USER_KEY_PREFIX_INDEX_DELETED)
+    {
+      e->user_ref_as_uword &= ~ASN_USER_KEY_PREFIX_INDEX_DELETED;
+      x->n_deleted_run_elts--;
+    }
+  return 1;
+}
+
+void asn_user_key_prefix_index_add (asn_user_key_prefix_index_t * x, u8 * key, uword user_ref_as_uword)
+{
+  asn_user_key_prefix_index_elt_t * e;
+  u64 p = asn_user_key_prefix (key);
+  uword i;
+
+  ASSERT (! (user_ref_as_uword & ASN_USER_KEY_PREFIX_INDEX_DELETED));
+
+  if (asn_user_key_prefix_index_undelete (x, p, user_ref_as_uword))
+    return;
+
+  i = asn_user_key_prefix_index_lower_bound (x->recent, p, user_ref_as_uword);
+  vec_insert (x->recent, 1, i);
+  e = x->recent + i;
+  e->key_prefix = p;
+  e->user_ref_as_uword = user_ref_as_uword;
+
+  if (vec_len (x->recent) >= ASN_USER_KEY_PREFIX_INDEX_MAX_RECENT)
     {
-      hv.as_uword = p[0];
-      asn_user_hash_value_update (&hv, r_as_uword);
-      p[0] = hv.as_uword;
+      asn_user_key_prefix_index_add_run (x, x->recent);
+      x->recent = 0;
     }
+}
+
+/* Sorts given elements and adds those not already in index as one run. */
+void asn_user_key_prefix_index_add_multiple (asn_user_key_prefix_index_t * x, asn_user_key_prefix_index_elt_t * elts)
+{
+  asn_user_key_prefix_index_elt_t * e;
+  uword i, j;
+
+  if (vec_len (elts) > 1)
+    vec_sort (elts, (void *) asn_user_key_prefix_index_elt_sort);
 
-  p = hash_get (am->user_ref_by_public_encrypt_key_first_8_bytes[rt], k);
-  if (! p)
+  for (i = j = 0; i < vec_len (elts); i++)
     {
-      hv.is_inline = 1;
-      hv.inline_value = r_as_uword;
-      hash_set (am->user_ref_by_public_encrypt_key_first_8_bytes[rt], k, hv.as_uword);
+      e = elts + i;
+      ASSERT (! (e->user_ref_as_uword & ASN_USER_KEY_PREFIX_INDEX_DELETED));
+      if (j > 0 && ! asn_user_key_prefix_index_elt_sort (elts + j - 1, e))
+	continue;
+      if (asn_user_key_prefix_index_undelete (x, e->key_prefix, e->user_ref_as_uword))
+	continue;
+      elts[j++] = e[0];
     }
-  else
+  if (elts)
+    vec_set_len (elts, j);
+
+  asn_user_key_prefix_index_add_run (x, vec_dup (elts));
+}
+
+static void
+asn_user_key_prefix_index_del_helper (asn_user_key_prefix_index_t * x, u64 key_prefix, uword user_ref_as_uword)
+{
+  asn_user_key_prefix_index_elt_t * e;
+
+  if ((e = asn_user_key_prefix_index_find (x->recent, key_prefix, user_ref_as_uword)))
+    {
+      vec_delete (x->recent, 1, e - x->recent);
+      return;
+    }
+
+  e = asn_user_key_prefix_index_find_in_runs (x, key_prefix, user_ref_as_uword);
+  if (e && ! (e->user_ref_as_uword & ASN_USER_KEY_PREFIX_INDEX_DELETED))
     {
-      hv.as_uword = p[0];
-      asn_user_hash_value_update (&hv, r_as_uword);
-      p[0] = hv.as_uword;
+      e->user_ref_as_uword |= ASN_USER_KEY_PREFIX_INDEX_DELETED;
+      x->n_deleted_run_elts++;
     }
+}
+
+void asn_user_key_prefix_index_del (asn_user_key_prefix_index_t * x, u8 * key, uword user_ref_as_uword)
+{
+  asn_user_key_prefix_index_del_helper (x, asn_user_key_prefix (key), user_ref_as_uword);
+  if (2 * x->n_deleted_run_elts > x->n_run_elts)
+    asn_user_key_prefix_index_compact (x);
+}
+
+/* Removes given elements compacting runs at most once. */
+void asn_user_key_prefix_index_del_multiple (asn_user_key_prefix_index_t * x, asn_user_key_prefix_index_elt_t * elts)
+{
+  asn_user_key_prefix_index_elt_t * e;
+
+  vec_foreach (e, elts)
+    asn_user_key_prefix_index_del_helper (x, e->key_prefix, e->user_ref_as_uword);
+  if (2 * x->n_deleted_run_elts > x->n_run_elts)
+    asn_user_key_prefix_index_compact (x);
+}
+
+void asn_user_key_prefix_index_free (asn_user_key_prefix_index_t * x)
+{
+  asn_user_key_prefix_index_elt_t ** r;
+  vec_foreach (r, x->runs)
+    vec_free (r[0]);
+  vec_free (x->runs);
+  vec_free (x->recent);
+  x->n_run_elts = x->n_deleted_run_elts = 0;
+}
+
+static uword *
+asn_user_key_prefix_index_match (asn_user_key_prefix_index_elt_t * v, u8 * key, uword n_key_bytes,
+				 u64 lo, u64 hi, uword * result_vector)
+{
+  uword i;
+  for (i = asn_user_key_prefix_index_lower_bound (v, lo, 0); i < vec_len (v) && v[i].key_prefix <= hi; i++)
+    {
+      if (v[i].user_ref_as_uword & ASN_USER_KEY_PREFIX_INDEX_DELETED)
+	continue;
+      if (n_key_bytes > sizeof (u64))
+	{
+	  asn_user_t * au = asn_user_by_ref_as_uword (v[i].user_ref_as_uword);
+	  if (! au || memcmp (au->crypto_keys.public.encrypt_key + sizeof (u64), key + sizeof (u64), n_key_bytes - sizeof (u64)))
+	    continue;
+	}
+      vec_add1 (result_vector, v[i].user_ref_as_uword);
+    }
+  return result_vector;
+}
+
+uword *
+asn_users_matching_encrypt_key (asn_main_t * am, asn_rx_or_tx_t rt, u8 * encrypt_key, uword n_bytes,
+				uword * result_vector)
+{
+  asn_user_key_prefix_index_t * x = &am->user_ref_by_public_encrypt_key_prefix[rt];
+  u8 prefix[sizeof (u64)];
+  uword n_prefix_bytes = clib_min (n_bytes, sizeof (prefix));
+  u64 lo, hi;
+
+  ASSERT (n_bytes >= 1 && n_bytes <= STRUCT_SIZE_OF (asn_user_t, crypto_keys.public.encrypt_key));
+
+  /* Key may be shorter than 8 bytes. */
+  memset (prefix, 0, sizeof (prefix));
+  memcpy (prefix, encrypt_key, n_prefix_bytes);
+  lo = asn_user_key_prefix (prefix);
+  hi = n_prefix_bytes < sizeof (prefix) ? lo | (~0ULL >> (BITS (u8) * n_prefix_bytes)) : lo;
+
+  vec_reset_length (result_vector);
+  {
+    asn_user_key_prefix_index_elt_t ** r;
+    vec_foreach (r, x->runs)
+      result_vector = asn_user_key_prefix_index_match (r[0], encrypt_key, n_bytes, lo, hi, result_vector);
+  }
+  result_vector = asn_user_key_prefix_index_match (x->recent, encrypt_key, n_bytes, lo, hi, result_vector);
+  return result_vector;
+}
+
+static void asn_user_hash_by_public_key (asn_main_t * am, asn_rx_or_tx_t rt, asn_user_t * au)
+{
+  asn_user_ref_t r;
+  asn_crypto_keys_t * ck;
+  uword r_as_uword;
+
+  ck = &au->crypto_keys;
+
+  r.type_index = au->user_type_index;
+  r.user_index = au->index;
+  r_as_uword = asn_user_ref_as_uword (&r);
+
+  au->last_use = ++am->user_use_count;
+  asn_user_key_table_set (&am->user_ref_by_public_encrypt_key[rt], au);
+  asn_user_key_prefix_index_add (&am->user_ref_by_public_encrypt_key_prefix[rt], ck->public.encrypt_key, r_as_uword);
 
   if (CLIB_DEBUG > 0)
     {
@@ -233,7 +473,7 @@ static void asn_user_hash_by_public_key (asn_main_t * am, asn_rx_or_tx_t rt, asn
           break;
       ASSERT (i < vec_len (rv));
 
-      rv = asn_users_matching_encrypt_key (am, rt, ck->public.encrypt_key, 8, rv);
+      rv = asn_users_matching_encrypt_key (am, rt, ck->public.encrypt_key, sizeof (ck->public.encrypt_key), rv);
       for (i = 0; i < vec_len (rv); i++)
         if (rv[i] == r_as_uword)
           break;
@@ -242,6 +482,28 @@ static void asn_user_hash_by_public_key (asn_main_t * am, asn_rx_or_tx_t rt, asn
     }
 }
 
+/* Removes user's current key from table and prefix index so re-keying leaves no stale entries. */
+static void asn_user_unhash_by_public_key (asn_main_t * am, asn_rx_or_tx_t rt, asn_user_t * au)
+{
+  asn_user_key_table_t * t = &am->user_ref_by_public_encrypt_key[rt];
+  u8 * key = au->crypto_keys.public.encrypt_key;
+  asn_user_key_table_slot_t * s;
+  asn_user_ref_t r;
+  uword r_as_uword;
+
+  r.type_index = au->user_type_index;
+  r.user_index = au->index;
+  r_as_uword = asn_user_ref_as_uword (&r);
+
+  /* Table and prefix index entries are always added together. */
+  s = asn_user_key_table_get (t, key);
+  if (! s || s->user_ref_as_uword != r_as_uword)
+    return;
+
+  asn_user_key_table_unset (t, s);
+  asn_user_key_prefix_index_del (&am->user_ref_by_public_encrypt_key_prefix[rt], key, r_as_uword);
+}
+
 void asn_user_update_keys (asn_main_t * am,
                            asn_rx_or_tx_t rt,
                            asn_user_t * au,
@@ -253,6 +515,9 @@ void asn_user_update_keys (asn_main_t * am,
 
   ck = &au->crypto_keys;
 
+  if (with_public_keys || with_private_keys || with_random_private_keys)
+    asn_user_unhash_by_public_key (am, ASN_TX, au);
+
   if (with_public_keys)
     {
       /* With public keys implies that private keys are invalid. */
@@ -293,6 +558,143 @@ void asn_user_update_keys (asn_main_t * am,
   asn_user_hash_by_public_key (am, ASN_TX, au);
 }
 
+/* Deletes user; with prefix_elts removal from prefix index is left to caller as one batch. */
+static void
+asn_user_del_helper (asn_main_t * am, asn_user_t * au, asn_user_key_prefix_index_elt_t ** prefix_elts)
+{
+  asn_user_type_t * ut = asn_user_type_for_user (au);
+  u8 * key = au->crypto_keys.public.encrypt_key;
+  asn_user_ref_t r;
+  uword r_as_uword, rt, i;
+
+  if (ut->will_delete_user)
+    ut->will_delete_user (am, au);
+
+  r.type_index = au->user_type_index;
+  r.user_index = au->index;
+  r_as_uword = asn_user_ref_as_uword (&r);
+
+  for (rt = 0; rt < ASN_N_RX_TX; rt++)
+    {
+      asn_user_key_table_t * t = &am->user_ref_by_public_encrypt_key[rt];
+      asn_user_key_table_slot_t * s = asn_user_key_table_get (t, key);
+      if (s && s->user_ref_as_uword == r_as_uword)
+	asn_user_key_table_unset (t, s);
+      if (! prefix_elts)
+	asn_user_key_prefix_index_del (&am->user_ref_by_public_encrypt_key_prefix[rt], key, r_as_uword);
+    }
+
+  if (prefix_elts)
+    {
+      asn_user_key_prefix_index_elt_t * e;
+      vec_add2 (prefix_elts[0], e, 1);
+      e->key_prefix = asn_user_key_prefix (key);
+      e->user_ref_as_uword = r_as_uword;
+    }
+
+  /* Forget blob time stamps so user is fetched fresh when learned again. */
+  vec_foreach_index (i, am->blob_types)
+    {
+      u64 ** ts = am->blob_types[i]->most_recent_time_stamp_in_nsec_from_1970_for_user_type_and_index;
+      if (r.type_index < vec_len (ts) && r.user_index < vec_len (ts[r.type_index]))
+	ts[r.type_index][r.user_index] = 0;
+    }
+
+  if (ut->free_user)
+    ut->free_user (au);
+  asn_user_free (au);
+  pool_put_index (ut->user_pool, r.user_index);
+}
+
+void asn_user_del (asn_main_t * am, asn_user_t * au)
+{ asn_user_del_helper (am, au, /* prefix_elts */ 0); }
+
+typedef struct {
+  u64 last_use;
+  u32 user_index;
+} asn_user_eviction_candidate_t;
+
+static int asn_user_eviction_candidate_sort (asn_user_eviction_candidate_t * c1, asn_user_eviction_candidate_t * c2)
+{
+  if (c1->last_use != c2->last_use)
+    return c1->last_use < c2->last_use ? -1 : +1;
+  return c1->user_index < c2->user_index ? -1 : (c1->user_index > c2->user_index);
+}
+
+/* Users referenced by pending exec ack handlers must survive until their acks arrive. */
+static uword *
+asn_users_keep_for_pending_exec_acks (asn_main_t * am, u32 user_type_index, uword * keep_user_bitmap)
+{
+  asn_socket_t * socket_pool = am->websocket_main.user_socket_pool;
+  uword si, ai;
+
+  vec_foreach_index (si, socket_pool)
+    {
+      asn_socket_t * as;
+      if (pool_is_free_index (socket_pool, si))
+	continue;
+      as = asn_socket_at_index (am, si);
+      vec_foreach_index (ai, as->exec_ack_handler_pool)
+	{
+	  asn_exec_ack_handler_t * ah;
+	  if (pool_is_free_index (as->exec_ack_handler_pool, ai))
+	    continue;
+	  ah = as->exec_ack_handler_pool[ai];
+	  if (ah && ah->keep_users)
+	    keep_user_bitmap = ah->keep_users (ah, user_type_index, keep_user_bitmap);
+	}
+    }
+
+  return keep_user_bitmap;
+}
+
+uword asn_users_evict (asn_main_t * am, u32 user_type_index, uword max_users, uword * keep_user_bitmap)
+{
+  asn_user_type_t * ut = pool_elt (asn_user_type_pool, user_type_index);
+  asn_user_eviction_candidate_t * cs = 0, * c;
+  asn_user_key_prefix_index_elt_t * prefix_elts = 0;
+  uword i, n_users, n_evict, rt;
+  void * u;
+
+  n_users = pool_elts (ut->user_pool);
+  if (n_users <= max_users)
+    return 0;
+
+  keep_user_bitmap = asn_users_keep_for_pending_exec_acks (am, user_type_index, clib_bitmap_dup (keep_user_bitmap));
+
+  u = ut->user_pool;
+  vec_foreach_index (i, ut->user_pool)
+    {
+      asn_user_t * au = u + ut->user_type_offset_of_asn_user;
+      u += ut->user_type_n_bytes;
+
+      if (pool_is_free_index (ut->user_pool, i)
+	  || asn_user_is_owned_by_self (au)
+	  || clib_bitmap_get (keep_user_bitmap, i)
+	  || (am->self_user_ref.type_index == user_type_index && am->self_user_ref.user_index == i))
+	continue;
+
+      vec_add2 (cs, c, 1);
+      c->last_use = au->last_use;
+      c->user_index = i;
+    }
+
+  if (vec_len (cs) > 1)
+    vec_sort (cs, (void *) asn_user_eviction_candidate_sort);
+
+  n_evict = clib_min (n_users - max_users, vec_len (cs));
+  for (i = 0; i < n_evict; i++)
+    asn_user_del_helper (am, asn_user_by_index_and_type (cs[i].user_index, user_type_index), &prefix_elts);
+
+  for (rt = 0; rt < ASN_N_RX_TX; rt++)
+    asn_user_key_prefix_index_del_multiple (&am->user_ref_by_public_encrypt_key_prefix[rt], prefix_elts);
+
+  clib_bitmap_free (keep_user_bitmap);
+  vec_free (prefix_elts);
+  vec_free (cs);
+  return n_evict;
+}
+
 void serialize_asn_public_keys (serialize_main_t * m, va_list * va)
 {
   asn_crypto_public_keys_t * pk = va_arg (*va, asn_crypto_public_keys_t *);
@@ -331,14 +733,12 @@ asn_new_user_with_type (asn_main_t * am,
 {
   asn_user_t * au;
   asn_user_type_t * ut = pool_elt (asn_user_type_pool, user_type_index);
-  uword * p;
 
   /* See if user already exists. */
   if (with_public_keys
       && pool_elts (ut->user_pool) > 0
-      && (p = hash_get_mem (am->user_ref_by_public_encrypt_key[rt], with_public_keys->encrypt_key)))
+      && (au = asn_user_with_encrypt_key (am, rt, with_public_keys->encrypt_key)))
     {
-      au = asn_user_by_ref_as_uword (p[0]);
       ASSERT (au->user_type_index == user_type_index);
       return au;
     }
@@ -349,6 +749,57 @@ asn_new_user_with_type (asn_main_t * am,
   return au;
 }
 
+uword *
+asn_users_bulk_insert (asn_main_t * am,
+		       asn_rx_or_tx_t rt,
+		       u32 user_type_index,
+		       asn_crypto_public_keys_t * public_keys,
+		       uword * result_user_refs)
+{
+  asn_user_type_t * ut = pool_elt (asn_user_type_pool, user_type_index);
+  asn_user_key_table_t * t = &am->user_ref_by_public_encrypt_key[rt];
+  asn_user_key_prefix_index_elt_t * elts = 0, * e;
+  asn_crypto_public_keys_t * pk;
+  asn_user_t * au;
+  asn_user_ref_t r;
+
+  /* Size key table once for all keys instead of growing it while inserting. */
+  asn_user_key_table_resize (t, t->n_elts + vec_len (public_keys));
+  vec_resize (elts, vec_len (public_keys));
+  vec_reset_length (elts);
+
+  vec_reset_length (result_user_refs);
+  vec_foreach (pk, public_keys)
+    {
+      au = asn_user_with_encrypt_key (am, rt, pk->encrypt_key);
+      if (! au)
+	{
+	  au = asn_user_alloc_with_type (ut);
+	  au->crypto_keys.public = pk[0];
+	  memset (&au->crypto_keys.private, ~0, sizeof (au->crypto_keys.private));
+	  au->private_key_is_valid = 0;
+	  au->last_use = ++am->user_use_count;
+	  asn_user_key_table_set (t, au);
+
+	  r.type_index = au->user_type_index;
+	  r.user_index = au->index;
+	  vec_add2 (elts, e, 1);
+	  e->key_prefix = asn_user_key_prefix (pk->encrypt_key);
+	  e->user_ref_as_uword = asn_user_ref_as_uword (&r);
+	}
+      ASSERT (au->user_type_index == user_type_index);
+
+      r.type_index = au->user_type_index;
+      r.user_index = au->index;
+      vec_add1 (result_user_refs, asn_user_ref_as_uword (&r));
+    }
+
+  asn_user_key_prefix_index_add_multiple (&am->user_ref_by_public_encrypt_key_prefix[rt], elts);
+  vec_free (elts);
+
+  return result_user_refs;
+}
+
 u8 * format_asn_user_mark_response (u8 * s, va_list * va)
 {
   asn_user_mark_response_t * r = va_arg (*va, asn_user_mark_response_t *);
@@ -412,144 +863,514 @@ u8 * format_asn_user_with_key (u8 * s, va_list * va)
   return s;
 }
 
+always_inline u32
+asn_pdu_max_user_data_bytes_per_frame (asn_pdu_t * p)
+{
+  return (p->max_user_data_bytes_per_frame
+	  ? p->max_user_data_bytes_per_frame
+	  : asn_pdu_frame_max_user_data_bytes (ASN_PDU_FRAME_LOG2_DEFAULT_BYTES));
+}
+
+asn_pdu_frame_cache_t asn_pdu_uncached_frame_counts;
+
 static void
-asn_pdu_sync_overflow (asn_pdu_t * p)
-{
-  u32 n_left_overflow = vec_len (p->overflow_data);
-  u32 n_left_this_frame;
-  asn_pdu_frame_t * f = &p->last_frame;
-
-  ASSERT (p->n_user_bytes_in_last_frame <= sizeof (f->user_data));
-  n_left_this_frame = sizeof (f->user_data) - p->n_user_bytes_in_last_frame;
-  while (n_left_overflow > 0)
-    {
-      u32 n_copy_this_frame = clib_min (n_left_overflow, n_left_this_frame);
-      memcpy (f->user_data + p->n_user_bytes_in_last_frame, p->overflow_data, n_copy_this_frame);
-      n_left_this_frame -= n_copy_this_frame;
-      n_left_overflow -= n_copy_this_frame;
-      vec_delete (p->overflow_data, n_copy_this_frame, 0);
-      if (n_left_this_frame == 0)
-        {
-          f->n_user_data_bytes = sizeof (f->user_data);
-          vec_add1 (p->full_frames, p->last_frame);
-          n_left_this_frame = sizeof (f->user_data);
-          p->n_user_bytes_in_last_frame = 0;
-        }
+asn_pdu_frame_cache_put (asn_pdu_frame_cache_t * c, asn_pdu_frame_t * f, u32 max_user_data_bytes_per_frame)
+{
+  if (c
+      && max_user_data_bytes_per_frame == c->max_user_data_bytes_per_frame
+      && vec_len (c->free_frames) < ASN_PDU_FRAME_CACHE_MAX_FRAMES)
+    vec_add1 (c->free_frames, f);
+  else
+    {
+      (c ? c : &asn_pdu_uncached_frame_counts)->n_frame_frees++;
+      clib_mem_free (f);
     }
+}
 
-  p->n_user_bytes_in_last_frame = sizeof (f->user_data) - n_left_this_frame;
-  vec_reset_length (p->overflow_data);
+void asn_pdu_frame_cache_free (asn_pdu_frame_cache_t * c)
+{
+  asn_pdu_frame_t ** f, *** v;
+  vec_foreach (f, c->free_frames)
+    clib_mem_free (f[0]);
+  c->n_frame_frees += vec_len (c->free_frames);
+  vec_free (c->free_frames);
+  vec_foreach (v, c->free_frame_vectors)
+    vec_free (v[0]);
+  vec_free (c->free_frame_vectors);
 }
 
-void *
-asn_socket_tx_add (asn_socket_t * as, u32 n_bytes, uword want_new_pdu)
+u8 * format_asn_pdu_frame_cache (u8 * s, va_list * va)
 {
-  asn_pdu_t * p;
+  asn_pdu_frame_cache_t * c = va_arg (*va, asn_pdu_frame_cache_t *);
+  return format (s, "frames: %Ld allocs, %Ld frees, %Ld reuses, %d free",
+		 c->n_frame_allocs, c->n_frame_frees, c->n_frame_reuses, vec_len (c->free_frames));
+}
+
+static asn_pdu_frame_t *
+asn_pdu_add_frame (asn_pdu_t * p)
+{
+  asn_pdu_frame_cache_t * c = p->frame_cache;
+  u32 n_max = asn_pdu_max_user_data_bytes_per_frame (p);
   asn_pdu_frame_t * f;
-  void * d;
-  u32 n_left_this_frame;
 
-  if (want_new_pdu)
-    vec_add2 (as->tx_pdus, p, 1);
-  else
-    p = vec_end (as->tx_pdus) - 1;
+  /* Frame size changed: drop frames of old size. */
+  if (c && c->max_user_data_bytes_per_frame != n_max)
+    {
+      asn_pdu_frame_t ** g;
+      vec_foreach (g, c->free_frames)
+	clib_mem_free (g[0]);
+      c->n_frame_frees += vec_len (c->free_frames);
+      vec_reset_length (c->free_frames);
+      c->max_user_data_bytes_per_frame = n_max;
+    }
 
-  f = &p->last_frame;
-  n_left_this_frame = sizeof (f->user_data) - p->n_user_bytes_in_last_frame;
-  if (n_bytes <= n_left_this_frame && vec_len (p->overflow_data) == 0)
+  if (c && vec_len (c->free_frames) > 0)
     {
-      d = f->user_data + p->n_user_bytes_in_last_frame;
-      p->n_user_bytes_in_last_frame += n_bytes;
+      f = vec_pop (c->free_frames);
+      c->n_frame_reuses++;
     }
   else
     {
-      vec_resize (p->overflow_data, n_bytes);
-      d = vec_end (p->overflow_data) - n_bytes;
+      f = clib_mem_alloc (STRUCT_OFFSET_OF (asn_pdu_frame_t, user_data) + n_max);
+      (c ? c : &asn_pdu_uncached_frame_counts)->n_frame_allocs++;
+    }
+
+  f->n_user_data_bytes = 0;
+  vec_add1 (p->frames, f);
+  return f;
+}
+
+void asn_pdu_free (asn_pdu_t * p)
+{
+  asn_pdu_frame_cache_t * c = p->frame_cache;
+  u32 n_max = asn_pdu_max_user_data_bytes_per_frame (p);
+  asn_pdu_frame_t ** f;
+
+  vec_foreach (f, p->frames)
+    asn_pdu_frame_cache_put (c, f[0], n_max);
+
+  if (c && p->frames)
+    {
+      vec_reset_length (p->frames);
+      vec_add1 (c->free_frame_vectors, p->frames);
+      p->frames = 0;
     }
+  else
+    vec_free (p->frames);
+
+  if (p->blob_writer)
+    asn_blob_writer_free (p->blob_writer);
+  p->blob_writer = 0;
+}
+
+always_inline asn_pdu_frame_t *
+asn_pdu_last_frame (asn_pdu_t * p)
+{ return vec_len (p->frames) > 0 ? vec_end (p->frames)[-1] : 0; }
+
+void *
+asn_pdu_reserve (asn_pdu_t * p, u32 n_bytes)
+{
+  asn_pdu_frame_t * f = asn_pdu_last_frame (p);
+  u32 n_max = asn_pdu_max_user_data_bytes_per_frame (p);
+  u8 * d;
 
+  ASSERT (n_bytes <= n_max);
+  if (! f || f->n_user_data_bytes + n_bytes > n_max)
+    f = asn_pdu_add_frame (p);
+
+  d = f->user_data + f->n_user_data_bytes;
+  f->n_user_data_bytes += n_bytes;
   memset (d, 0, n_bytes);
   return d;
 }
 
+void
+asn_pdu_append (asn_pdu_t * p, void * data, uword n_bytes)
+{
+  asn_pdu_frame_t * f = asn_pdu_last_frame (p);
+  u32 n_max = asn_pdu_max_user_data_bytes_per_frame (p);
+  u8 * d = data;
+  u32 n_copy;
+
+  while (n_bytes > 0)
+    {
+      if (! f || f->n_user_data_bytes == n_max)
+        f = asn_pdu_add_frame (p);
+
+      n_copy = clib_min (n_bytes, n_max - f->n_user_data_bytes);
+      memcpy (f->user_data + f->n_user_data_bytes, d, n_copy);
+      f->n_user_data_bytes += n_copy;
+      d += n_copy;
+      n_bytes -= n_copy;
+    }
+}
+
+always_inline asn_pdu_t *
+asn_socket_tx_last_pdu (asn_socket_t * as)
+{
+  ASSERT (vec_len (as->tx_pdus) > 0);
+  return vec_end (as->tx_pdus) - 1;
+}
+
+always_inline u32
+asn_main_rx_log2_max_frame_bytes (asn_main_t * am)
+{
+  u32 l = am->rx_log2_max_frame_bytes;
+  if (l == 0)
+    l = ASN_PDU_FRAME_LOG2_DEFAULT_BYTES;
+  return clib_max (ASN_PDU_FRAME_LOG2_DEFAULT_BYTES, clib_min (l, ASN_PDU_FRAME_LOG2_MAX_BYTES));
+}
+
+/* Learn peer's maximum frame size from version of received PDU. */
+always_inline void
+asn_socket_rx_version (asn_main_t * am, asn_socket_t * as, u8 version)
+{
+  u32 l = ASN_PDU_FRAME_LOG2_DEFAULT_BYTES + (version & ASN_PDU_VERSION_LOG2_FRAME_BYTES_MASK);
+  as->tx_log2_frame_bytes = clib_min (l, asn_main_rx_log2_max_frame_bytes (am));
+}
+
 always_inline void *
-asn_socket_tx_add_pdu (asn_socket_t * as, asn_pdu_id_t id, u32 n_header_bytes)
+asn_socket_tx_add_pdu (asn_main_t * am, asn_socket_t * as, asn_pdu_id_t id, u32 n_header_bytes)
 {
-  asn_pdu_header_t * h = asn_socket_tx_add (as, n_header_bytes, /* want_new_pdu */ 1);
+  asn_pdu_header_t * h;
+  asn_pdu_t * p;
+
   ASSERT (n_header_bytes >= sizeof (h[0]));
-  memset (h, 0, sizeof (h[0]));
-  h->version = 0;
+  vec_add2 (as->tx_pdus, p, 1);
+  memset (p, 0, sizeof (p[0]));
+  if (! as->tx_frame_cache)
+    {
+      as->tx_frame_cache = clib_mem_alloc (sizeof (as->tx_frame_cache[0]));
+      memset (as->tx_frame_cache, 0, sizeof (as->tx_frame_cache[0]));
+    }
+  p->frame_cache = as->tx_frame_cache;
+  if (vec_len (p->frame_cache->free_frame_vectors) > 0)
+    p->frames = vec_pop (p->frame_cache->free_frame_vectors);
+  if (as->tx_log2_frame_bytes > ASN_PDU_FRAME_LOG2_DEFAULT_BYTES)
+    p->max_user_data_bytes_per_frame = asn_pdu_frame_max_user_data_bytes (as->tx_log2_frame_bytes);
+
+  h = asn_pdu_reserve (p, n_header_bytes);
+  h->version = asn_main_rx_log2_max_frame_bytes (am) - ASN_PDU_FRAME_LOG2_DEFAULT_BYTES;
   h->id = id;
   h->generic_request_id.id = id;	/* remote will echo */
   return h;
 }
 
-static clib_error_t *
-asn_socket_transmit_frame (asn_socket_t * as, asn_pdu_frame_t * f, uword n_user_data_bytes, uword is_last_frame)
+static void
+asn_socket_transmit_frame (asn_socket_t * as, asn_pdu_frame_t * tf, uword n_user_data_bytes, uword is_last_frame)
 {
   websocket_socket_t * ws = &as->websocket_socket;
+  clib_socket_t * s = &ws->clib_socket;
   asn_crypto_state_t * cs = &as->ephemeral_crypto_state;
-  u8 crypto_box_buffer[crypto_box_reserved_pad_bytes + sizeof (f->user_data)];
+  asn_pdu_frame_t * f;
+  uword l, n_tx_bytes;
 
-  ASSERT (n_user_data_bytes <= sizeof (f->user_data));
+  ASSERT (n_user_data_bytes <= asn_pdu_frame_max_user_data_bytes (ASN_PDU_FRAME_LOG2_MAX_BYTES));
 
-  memset (crypto_box_buffer, 0, crypto_box_reserved_pad_bytes);
-  memcpy (crypto_box_buffer + crypto_box_reserved_pad_bytes, f->user_data, n_user_data_bytes);
+  n_tx_bytes = STRUCT_OFFSET_OF (asn_pdu_frame_t, user_data) + n_user_data_bytes;
 
-  crypto_box_afternm (crypto_box_buffer, crypto_box_buffer, crypto_box_reserved_pad_bytes + n_user_data_bytes,
-		      cs->nonce[ASN_TX], cs->shared_secret);
-  asn_crypto_increment_nonce (cs->nonce[ASN_TX], 2);
+  /* Encrypt straight into socket's transmit buffer. */
+  l = vec_len (s->tx_buffer);
+  vec_resize (s->tx_buffer, n_tx_bytes);
+  f = (void *) (s->tx_buffer + l);
 
-  /* Copy in authenticator + encrypted user data. */
-  memcpy (f->user_data_authentication, crypto_box_buffer + crypto_box_reserved_pad_authentication_offset,
-	  sizeof (f->user_data_authentication));
-  memcpy (f->user_data, crypto_box_buffer + crypto_box_reserved_pad_bytes, n_user_data_bytes);
+  crypto_box_detached_afternm (f->user_data, f->user_data_authentication,
+			       tf->user_data, n_user_data_bytes,
+			       cs->nonce[ASN_TX], cs->shared_secret);
+  asn_crypto_increment_nonce (cs->nonce[ASN_TX], 2);
 
   f->n_bytes_that_follow_and_more_flag_network_byte_order
     = clib_host_to_net_u16 ((n_user_data_bytes + sizeof (f->user_data_authentication))
 			    | ((is_last_frame == 0) << ASN_PDU_FRAME_LOG2_MORE_FLAG));
 
-  clib_socket_tx_add (&ws->clib_socket, f, STRUCT_OFFSET_OF (asn_pdu_frame_t, user_data) + n_user_data_bytes);
-  return websocket_socket_tx_binary_frame (ws);
+  as->tx_n_bytes_in_websocket_frame += n_tx_bytes;
 }
 
+/* Send ASN frames added since last websocket frame as a single websocket data frame. */
 static clib_error_t *
-asn_socket_transmit_and_reset_pdu (asn_socket_t * as, asn_pdu_t * pdu)
+asn_socket_tx_websocket_frame (asn_socket_t * as)
 {
+  if (as->tx_n_bytes_in_websocket_frame == 0)
+    return 0;
+  as->tx_n_bytes_in_websocket_frame = 0;
+  return websocket_socket_tx_binary_frame (&as->websocket_socket);
+}
+
+/* Transmit frame closing current websocket frame first if this ASN frame would not fit. */
+static clib_error_t *
+asn_socket_tx_frame (asn_main_t * am, asn_socket_t * as, asn_pdu_frame_t * f, uword is_last_frame)
+{
+  clib_error_t * error = 0;
+  uword n_tx_bytes = STRUCT_OFFSET_OF (asn_pdu_frame_t, user_data) + f->n_user_data_bytes;
+
+  if (as->tx_n_bytes_in_websocket_frame + n_tx_bytes > am->tx_coalesce_max_websocket_frame_bytes)
+    error = asn_socket_tx_websocket_frame (as);
+
+  if (! error)
+    asn_socket_transmit_frame (as, f, f->n_user_data_bytes, is_last_frame);
+
+  return error;
+}
+
+static clib_error_t *
+asn_socket_transmit_and_reset_pdu (asn_main_t * am, asn_socket_t * as, asn_pdu_t * pdu)
+{
+  clib_error_t * error = 0;
+  uword i, n_frames;
+
+  n_frames = vec_len (pdu->frames);
+  ASSERT (n_frames > 0);
+  for (i = 0; i < n_frames; i++)
+    {
+      error = asn_socket_tx_frame (am, as, pdu->frames[i], /* is_last_frame */ i + 1 == n_frames);
+      if (error)
+	break;
+    }
+
+  asn_pdu_free (pdu);
+
+  return error;
+}
+
+static clib_error_t *
+asn_blob_writer_read_file_descriptor (asn_blob_writer_t * bw, u8 * data, u32 n_bytes, u32 * n_bytes_read)
+{
+  ssize_t n;
+
+  do {
+    n = read (bw->file_descriptor, data, n_bytes);
+  } while (n < 0 && errno == EINTR);
+
+  if (n < 0)
+    return clib_error_return_unix (0, "read fd %d", bw->file_descriptor);
+
+  *n_bytes_read = n;
+  return 0;
+}
+
+asn_blob_writer_t * asn_blob_writer_create_for_file_descriptor (int fd)
+{
+  asn_blob_writer_t * bw = asn_blob_writer_create_with_function_in_container (asn_blob_writer_read_file_descriptor, sizeof (bw[0]),
+									       /* object_offset_of_blob_writer */ 0);
+  bw->file_descriptor = fd;
+  return bw;
+}
+
+void asn_blob_writer_free (asn_blob_writer_t * bw)
+{
+  if (bw->free)
+    bw->free (bw);
+  if (bw->file_descriptor != ~0)
+    close (bw->file_descriptor);
+  clib_mem_free_in_container (bw, bw->container_offset_of_object);
+}
+
+/* Read blob contents into PDU's last frame and transmit while socket's transmit buffer has space.
+   Frames are filled and sent one at a time so only one frame buffer is used for any blob size.
+   Sets *IS_DONE and frees PDU when whole PDU has been sent or contents could not be read;
+   for the latter *MUST_CLOSE is also set. */
+static clib_error_t *
+asn_socket_transmit_blob_writer_pdu (asn_main_t * am, asn_socket_t * as, asn_pdu_t * pdu, uword * is_done, uword * must_close)
+{
+  clib_error_t * error = 0, * read_error = 0;
+  clib_socket_t * s = &as->websocket_socket.clib_socket;
+  asn_blob_writer_t * bw = pdu->blob_writer;
   asn_pdu_frame_t * f;
-  clib_error_t * error;
+  u32 n_read, max_tx_buffer_bytes, n_max = asn_pdu_max_user_data_bytes_per_frame (pdu);
+
+  *is_done = *must_close = 0;
+  max_tx_buffer_bytes = am->tx_blob_writer_max_buffer_bytes;
+  if (max_tx_buffer_bytes == 0)
+    max_tx_buffer_bytes = ASN_BLOB_WRITER_DEFAULT_MAX_TX_BUFFER_BYTES;
 
-  asn_pdu_sync_overflow (pdu);
+  /* Header frames before last one are already full. */
+  while (vec_len (pdu->frames) > 1)
+    {
+      error = asn_socket_tx_frame (am, as, pdu->frames[0], /* is_last_frame */ 0);
+      asn_pdu_frame_cache_put (pdu->frame_cache, pdu->frames[0], n_max);
+      vec_delete (pdu->frames, 1, 0);
+      if (error)
+	goto done;
+    }
 
-  vec_foreach (f, pdu->full_frames)
+  f = asn_pdu_last_frame (pdu);
+  while (vec_len (s->tx_buffer) < max_tx_buffer_bytes)
     {
-      error = asn_socket_transmit_frame (as, f, f->n_user_data_bytes, /* is_last_frame */ 0);
+      n_read = ~0;
+      while (f->n_user_data_bytes < n_max)
+	{
+	  n_read = 0;
+	  read_error = bw->read_function (bw, f->user_data + f->n_user_data_bytes,
+					  n_max - f->n_user_data_bytes,
+					  &n_read);
+	  if (read_error || n_read == 0)
+	    break;
+	  f->n_user_data_bytes += n_read;
+	  bw->n_bytes_read += n_read;
+	}
+
+      /* On read error never end PDU: peer would store truncated blob as complete.
+	 Instead socket is closed so peer drops partial exec. */
+      if (read_error)
+	{
+	  *must_close = 1;
+	  goto done;
+	}
+
+      /* End of contents. */
+      if (n_read == 0)
+	{
+	  error = asn_socket_tx_frame (am, as, f, /* is_last_frame */ 1);
+	  goto done;
+	}
+
+      error = asn_socket_tx_frame (am, as, f, /* is_last_frame */ 0);
       if (error)
 	goto done;
+
+      /* Re-use frame buffer for next contents. */
+      f->n_user_data_bytes = 0;
     }
 
-  error = asn_socket_transmit_frame (as, &pdu->last_frame, pdu->n_user_bytes_in_last_frame, /* is_last_frame */ 1);
+  /* Wait for transmit space. */
+  return 0;
 
  done:
   asn_pdu_free (pdu);
-  pdu->n_user_bytes_in_last_frame = 0;
-
+  *is_done = 1;
+  if (read_error)
+    error = clib_error_return (error, "blob read failed after %Ld bytes, closing socket: %U",
+			       bw->n_bytes_read, format_clib_error, read_error);
+  clib_error_free (read_error);
   return error;
 }
 
-clib_error_t * asn_socket_tx (asn_socket_t * as)
+/* Remember socket for transmit at next flush. */
+static void
+asn_socket_set_tx_pending (asn_main_t * am, asn_socket_t * as)
+{
+  if (! as->tx_is_pending)
+    {
+      as->tx_is_pending = 1;
+      vec_add1 (am->tx_pending_socket_indices, as->websocket_socket.index);
+    }
+}
+
+clib_error_t * asn_socket_tx (asn_main_t * am, asn_socket_t * as)
 {
   clib_error_t * error = 0;
   asn_pdu_t * pdu;
+  uword n_done = 0, is_done, must_close = 0;
+
   vec_foreach (pdu, as->tx_pdus)
     {
-      error = asn_socket_transmit_and_reset_pdu (as, pdu);
       if (error)
+	asn_pdu_free (pdu);
+      else if (pdu->blob_writer)
+	{
+	  error = asn_socket_transmit_blob_writer_pdu (am, as, pdu, &is_done, &must_close);
+
+	  /* Blob writer waiting for space: keep it and PDUs behind it in order. */
+	  if (! is_done)
+	    break;
+	}
+      else
+	error = asn_socket_transmit_and_reset_pdu (am, as, pdu);
+      n_done++;
+      if (must_close)
 	break;
     }
-  vec_reset_length (as->tx_pdus);
+
+  vec_delete (as->tx_pdus, n_done, 0);
+
+  /* Blob contents could not be read.  End websocket frame so frames already encrypted
+     are never left without a header; closing then frees socket and its remaining PDUs. */
+  if (must_close)
+    {
+      clib_error_t * frame_error = asn_socket_tx_websocket_frame (as);
+      if (frame_error)
+	clib_error_report (frame_error);
+      websocket_close (&am->websocket_main, &as->websocket_socket);
+      return error;
+    }
+
+  as->tx_is_pending = 0;
+  if (vec_len (as->tx_pdus) > 0)
+    asn_socket_set_tx_pending (am, as);
+
+  if (! error)
+    error = asn_socket_tx_websocket_frame (as);
   return error;
 }
 
+/* Transmit now unless socket is corked; otherwise remember socket for later flush. */
+static clib_error_t *
+asn_socket_tx_unless_corked (asn_main_t * am, asn_socket_t * as)
+{
+  if (as->tx_cork_count == 0 && am->tx_cork_count == 0)
+    return asn_socket_tx (am, as);
+
+  asn_socket_set_tx_pending (am, as);
+
+  return 0;
+}
+
+clib_error_t * asn_socket_uncork (asn_main_t * am, asn_socket_t * as)
+{
+  ASSERT (as->tx_cork_count > 0);
+  as->tx_cork_count--;
+  if (as->tx_cork_count == 0 && as->tx_is_pending && am->tx_cork_count == 0)
+    return asn_socket_tx (am, as);
+  return 0;
+}
+
+/* Flush all sockets with queued PDUs which are not explicitly corked. */
+static clib_error_t *
+asn_main_tx_pending_sockets (asn_main_t * am)
+{
+  clib_error_t * error = 0;
+  asn_socket_t * socket_pool = am->websocket_main.user_socket_pool;
+  asn_socket_t * as;
+  u32 * si, * flush;
+
+  /* Sockets may be queued again while flushing (e.g. blob writers waiting for transmit space). */
+  flush = am->tx_pending_socket_indices;
+  am->tx_pending_socket_indices = am->tx_flush_socket_indices;
+  am->tx_flush_socket_indices = 0;
+
+  vec_foreach (si, flush)
+    {
+      if (pool_is_free_index (socket_pool, si[0]))
+	continue;
+
+      as = asn_socket_at_index (am, si[0]);
+      if (! as->tx_is_pending)
+	continue;
+      as->tx_is_pending = 0;
+
+      /* Keep corked sockets (and the rest after an error) for next time. */
+      if (as->tx_cork_count > 0 || error)
+	{
+	  asn_socket_set_tx_pending (am, as);
+	  continue;
+	}
+
+      error = asn_socket_tx (am, as);
+    }
+
+  vec_reset_length (flush);
+  am->tx_flush_socket_indices = flush;
+
+  return error;
+}
+
+clib_error_t * asn_main_uncork (asn_main_t * am)
+{
+  ASSERT (am->tx_cork_count > 0);
+  am->tx_cork_count--;
+  return am->tx_cork_count == 0 ? asn_main_tx_pending_sockets (am) : 0;
+}
+
 static u8 * format_asn_pdu_id (u8 * s, va_list * va)
 {
   asn_pdu_id_t id = va_arg (*va, asn_pdu_id_t);
@@ -636,41 +1457,23 @@ static u8 * format_asn_exec_command (u8 * s, va_list * va)
   return s;
 }
 
+/* Queue exec PDU with given (already formatted) command on socket.
+   Contents, when given, are appended after command; blob writer, when given, supplies the rest of the PDU. */
 static clib_error_t *
-asn_socket_exec_helper (asn_main_t * am,
-                        asn_socket_t * as,
-                        asn_exec_ack_handler_t * ack_handler,
-                        char * fmt, va_list * va)
+asn_socket_exec_command (asn_main_t * am,
+			 asn_socket_t * as,
+			 asn_exec_ack_handler_t * ack_handler,
+			 u8 * cmd, u8 * contents,
+			 asn_blob_writer_t * blob_writer)
 {
-  u8 * s;
   asn_pdu_header_t * h;
+  asn_pdu_t * p;
 
-  if (! as)
-    {
-      clib_error_t * error = 0;
-      asn_client_socket_t * cs;
-      vec_foreach (cs, am->client_sockets)
-        {
-          if (cs->socket_index == ~0)
-            continue;
-          as = asn_socket_at_index (am, cs->socket_index);
-          if (as->session_state != ASN_SESSION_STATE_established)
-            continue;
-          error = asn_socket_exec_helper (am, as, ack_handler, fmt, va);
-          if (error)
-            break;
-        }
-
-      return error;
-    }
-
-  s = va_format (0, fmt, va);
-  if (0 && s[vec_len (s) - 1] != 0)  /* null terminate */
-    vec_add1 (s, 0);
-
-  h = asn_socket_tx_add_pdu (as, ASN_PDU_exec, sizeof (h[0]) + vec_len (s));
-
-  memcpy (h->data, s, vec_len (s));
+  h = asn_socket_tx_add_pdu (am, as, ASN_PDU_exec, sizeof (h[0]));
+  p = asn_socket_tx_last_pdu (as);
+  asn_pdu_append_vec (p, cmd);
+  asn_pdu_append_vec (p, contents);
+  p->blob_writer = blob_writer;
 
   {
     asn_exec_ack_handler_t ** ah;
@@ -681,11 +1484,66 @@ asn_socket_exec_helper (asn_main_t * am,
   }
 
   if (am->verbose)
-    clib_warning ("%U", format_asn_exec_command, h, s);
+    clib_warning ("%U", format_asn_exec_command, h, cmd);
+
+  return asn_socket_tx_unless_corked (am, as);
+}
+
+/* Exec command (plus contents) on given socket or on all established client sockets when AS is zero. */
+static clib_error_t *
+asn_exec_command_with_contents (asn_main_t * am,
+				asn_socket_t * as,
+				asn_exec_ack_handler_t * ack_handler,
+				u8 * cmd, u8 * contents)
+{
+  clib_error_t * error = 0;
+  asn_client_socket_t * cs;
+
+  if (as)
+    return asn_socket_exec_command (am, as, ack_handler, cmd, contents, /* blob_writer */ 0);
+
+  vec_foreach (cs, am->client_sockets)
+    {
+      if (cs->socket_index == ~0)
+	continue;
+      as = asn_socket_at_index (am, cs->socket_index);
+      if (as->session_state != ASN_SESSION_STATE_established)
+	continue;
+
+      /* Ack handler is freed when its ack arrives so only first socket gets it. */
+      error = asn_socket_exec_command (am, as, ack_handler, cmd, contents, /* blob_writer */ 0);
+      ack_handler = 0;
+      if (error)
+	break;
+    }
+
+  /* No established sockets: ack handler will never run. */
+  if (ack_handler)
+    {
+      if (ack_handler->free)
+	ack_handler->free (ack_handler, /* is_force */ 1);
+      clib_mem_free_in_container (ack_handler, ack_handler->container_offset_of_object);
+    }
+
+  return error;
+}
+
+static clib_error_t *
+asn_socket_exec_helper (asn_main_t * am,
+                        asn_socket_t * as,
+                        asn_exec_ack_handler_t * ack_handler,
+                        char * fmt, va_list * va)
+{
+  clib_error_t * error;
+  u8 * s;
 
-  vec_free (s);
+  /* Format command once; only framing and encryption is done per socket. */
+  s = va_format (am->tx_exec_command_buffer, fmt, va);
+  error = asn_exec_command_with_contents (am, as, ack_handler, s, /* contents */ 0);
+  vec_reset_length (s);
+  am->tx_exec_command_buffer = s;
 
-  return asn_socket_tx (as);
+  return error;
 }
 
 clib_error_t * asn_socket_exec (asn_main_t * am, asn_socket_t * as, asn_exec_ack_handler_function_t * f, char * fmt, ...)
@@ -889,20 +1747,16 @@ static u8 * format_asn_ack_pdu (u8 * s, va_list * va)
   return s;
 }
 
-static clib_error_t *
-asn_socket_rx_blob_pdu (asn_main_t * am,
-			asn_socket_t * as,
-			asn_pdu_blob_t * blob,
-			uword n_bytes_in_pdu)
+/* Find blob type by exact name or else by directory name. */
+static asn_blob_type_t *
+asn_blob_type_for_name (asn_main_t * am, u8 * name, u32 n_name_bytes)
 {
-  clib_error_t * error = 0;
-  asn_blob_type_t * bt;
   uword * p;
   u8 * n;
 
   n = 0;
-  if (blob->n_name_bytes > 0)
-    vec_add (n, blob->name, blob->n_name_bytes);
+  if (n_name_bytes > 0)
+    vec_add (n, name, n_name_bytes);
 
   p = hash_get_mem (am->blob_type_index_by_name, n);
 
@@ -920,23 +1774,34 @@ asn_socket_rx_blob_pdu (asn_main_t * am,
         }
     }
 
-  if (! p)
-    {
-      if (am->verbose)
-	clib_warning ("no handler for blob name `%v'", n);
-    }
-  else
+  if (! p && am->verbose)
+    clib_warning ("no handler for blob name `%v'", n);
+
+  vec_free (n);
+
+  return p ? vec_elt (am->blob_types, p[0]) : 0;
+}
+
+static clib_error_t *
+asn_socket_rx_blob_pdu (asn_main_t * am,
+			asn_socket_t * as,
+			asn_pdu_blob_t * blob,
+			uword n_bytes_in_pdu)
+{
+  clib_error_t * error = 0;
+  asn_blob_type_t * bt;
+
+  bt = asn_blob_type_for_name (am, blob->name, blob->n_name_bytes);
+  if (bt)
     {
       asn_blob_handler_t bh;
-      bt = vec_elt (am->blob_types, p[0]);
+      memset (&bh, 0, sizeof (bh));
       bh.asn_main = am;
       bh.asn_socket = as;
       bh.blob_type = bt;
       error = bt->handler (&bh, blob, n_bytes_in_pdu);
     }
 
-  vec_free (n);
-
   return error;
 }
 
@@ -1023,117 +1888,354 @@ u8 * format_asn_pdu (u8 * s, va_list * va)
 }
 
 static clib_error_t *
-asn_main_rx_frame_payload (websocket_main_t * wsm, websocket_socket_t * ws, u8 * rx_payload, u32 n_payload_bytes)
+asn_socket_rx_pdu (asn_main_t * am, asn_socket_t * as, asn_pdu_header_t * h, u32 n_bytes_in_pdu)
 {
-  asn_main_t * am = CONTAINER_OF (wsm, asn_main_t, websocket_main);
-  asn_socket_t * as = CONTAINER_OF (ws, asn_socket_t, websocket_socket);
   clib_error_t * error = 0;
-  asn_pdu_frame_t * f;
-  u8 crypto_box_buffer[crypto_box_reserved_pad_bytes + sizeof (f->user_data)];
-  u32 n_user_data_bytes, l, is_last_frame, is_server;
-  
-  is_server = websocket_connection_type (ws) == WEBSOCKET_CONNECTION_TYPE_server_client;
 
-  if (is_server && as->session_state == ASN_SESSION_STATE_opened)
+  if (n_bytes_in_pdu < sizeof (h[0]))
+    return clib_error_return (0, "short pdu %d bytes", n_bytes_in_pdu);
+
+  asn_socket_rx_version (am, as, h->version);
+
+  if (am->verbose)
+    clib_warning ("%U", format_asn_pdu, am, h, n_bytes_in_pdu);
+
+  switch (h->id)
     {
-      as->session_state = ASN_SESSION_STATE_established;
-      if (n_payload_bytes != sizeof (as->ephemeral_keys.public))
+#define _(f,n)								\
+      case ASN_PDU_##f:							\
+        error = asn_socket_rx_##f##_pdu (am, as, (void *) h, n_bytes_in_pdu); \
+        break;
+
+      foreach_asn_pdu_id;
+
+#undef _
+
+    default:
+      error = clib_error_return (0, "unknown pdu id 0x%x", h->id);
+      break;
+    }
+
+  return error;
+}
+
+/* Abandon PDU being received (e.g. after error or when socket is closed). */
+static void
+asn_socket_rx_pdu_reset (asn_socket_t * as)
+{
+  if (as->rx_blob_is_streaming)
+    {
+      asn_blob_handler_t * bh = &as->rx_blob_stream_handler;
+      clib_error_t * error = bh->blob_type->stream_end (bh, /* is_abort */ 1);
+      clib_error_free (error);
+      as->rx_blob_is_streaming = 0;
+    }
+
+  if (as->rx_pdu_is_spilled)
+    {
+      close (as->rx_pdu_spill_fd);
+      as->rx_pdu_is_spilled = 0;
+      as->rx_pdu_n_spill_bytes = 0;
+    }
+
+  vec_reset_length (as->rx_pdu);
+}
+
+static clib_error_t *
+asn_socket_rx_spill_data (asn_socket_t * as, u8 * data, uword n_bytes)
+{
+  ssize_t n;
+
+  while (n_bytes > 0)
+    {
+      n = write (as->rx_pdu_spill_fd, data, n_bytes);
+      if (n < 0)
 	{
-	  error = clib_error_return (0, "expected public key %d bytes received %d bytes",
-				     sizeof (as->ephemeral_keys.public), n_payload_bytes);
-	  goto done;
+	  if (errno == EINTR)
+	    continue;
+	  return clib_error_return_unix (0, "write spill file");
 	}
+      data += n;
+      n_bytes -= n;
+      as->rx_pdu_n_spill_bytes += n;
+    }
 
-      memcpy (as->ephemeral_crypto_state.nonce, am->server_nonce, sizeof (am->server_nonce));
-      crypto_box_beforenm (as->ephemeral_crypto_state.shared_secret, rx_payload, am->server_keys.private.encrypt_key);
+  return 0;
+}
 
-      /* FIXME ack with our ephemeral key and new nonce. */
+/* Move PDU received so far into an unlinked temporary file. */
+static clib_error_t *
+asn_socket_rx_pdu_spill (asn_socket_t * as)
+{
+  clib_error_t * error;
+  char * dir = getenv ("TMPDIR");
+  u8 * path;
+  int fd;
 
-      if (am->verbose)
-	clib_warning ("handshake received; ephemeral received %U",
-		      format_hex_bytes, rx_payload, sizeof (as->ephemeral_keys.public));
+  path = format (0, "%s/asn-rx-XXXXXX%c", dir ? dir : "/tmp", 0);
+  fd = mkstemp ((char *) path);
+  if (fd < 0)
+    {
+      error = clib_error_return_unix (0, "mkstemp `%s'", path);
+      vec_free (path);
+      return error;
+    }
+  unlink ((char *) path);
+  vec_free (path);
 
-      return 0;
+  as->rx_pdu_spill_fd = fd;
+  as->rx_pdu_is_spilled = 1;
+  as->rx_pdu_n_spill_bytes = 0;
+
+  error = asn_socket_rx_spill_data (as, as->rx_pdu, vec_len (as->rx_pdu));
+  vec_free (as->rx_pdu);
+
+  return error;
+}
+
+/* Dispatch spilled PDU with file mapped into memory. */
+static clib_error_t *
+asn_socket_rx_spilled_pdu (asn_main_t * am, asn_socket_t * as)
+{
+  clib_error_t * error;
+  void * h;
+  uword n_bytes = as->rx_pdu_n_spill_bytes;
+
+  h = mmap (0, n_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, as->rx_pdu_spill_fd, /* offset */ 0);
+  if (h == MAP_FAILED)
+    return clib_error_return_unix (0, "mmap spill file");
+
+  error = asn_socket_rx_pdu (am, as, h, n_bytes);
+
+  munmap (h, n_bytes);
+  return error;
+}
+
+/* Called for each non-last frame of a PDU.  Once blob header and name have arrived
+   either start streaming to blob type or (for large PDUs) spill to a temporary file. */
+static clib_error_t *
+asn_socket_rx_partial_pdu (asn_main_t * am, asn_socket_t * as, u32 n_bytes_this_frame)
+{
+  clib_error_t * error = 0;
+  asn_pdu_blob_t * blob = (void *) as->rx_pdu;
+  uword l = vec_len (as->rx_pdu), n_header_bytes, max_bytes;
+
+  /* Streamed PDUs never reach asn_socket_rx_pdu and spilled ones only do so at the end:
+     learn peer's frame size in frame which completes PDU header. */
+  if (l - n_bytes_this_frame < sizeof (blob->header) && l >= sizeof (blob->header))
+    asn_socket_rx_version (am, as, blob->header.version);
+
+  if (l >= sizeof (blob[0]) && blob->header.id == ASN_PDU_blob)
+    {
+      n_header_bytes = sizeof (blob[0]) + blob->n_name_bytes;
+
+      /* Decide once: in frame which completes header. */
+      if (l - n_bytes_this_frame < n_header_bytes && l >= n_header_bytes)
+	{
+	  asn_blob_type_t * bt = asn_blob_type_for_name (am, blob->name, blob->n_name_bytes);
+	  if (bt && bt->stream_begin)
+	    {
+	      asn_blob_handler_t * bh = &as->rx_blob_stream_handler;
+
+	      memset (bh, 0, sizeof (bh[0]));
+	      bh->asn_main = am;
+	      bh->asn_socket = as;
+	      bh->blob_type = bt;
+
+	      if (am->verbose)
+		clib_warning ("%U", format_asn_pdu, am, blob, n_header_bytes);
+
+	      error = bt->stream_begin (bh, blob);
+	      if (error)
+		return error;
+	      as->rx_blob_is_streaming = 1;
+
+	      if (l > n_header_bytes)
+		error = bt->stream_data (bh, as->rx_pdu + n_header_bytes, l - n_header_bytes);
+	      vec_reset_length (as->rx_pdu);
+	      return error;
+	    }
+	}
     }
 
-  vec_add (as->rx_frame, rx_payload, n_payload_bytes);
-  f = (void *) as->rx_frame;
+  max_bytes = am->rx_pdu_spill_bytes;
+  if (max_bytes == 0)
+    max_bytes = ASN_RX_PDU_DEFAULT_SPILL_BYTES;
+  if (l >= max_bytes)
+    error = asn_socket_rx_pdu_spill (as);
+
+  return error;
+}
 
-  l = clib_net_to_host_u16 (f->n_bytes_that_follow_and_more_flag_network_byte_order);
-  is_last_frame = (l & ASN_PDU_FRAME_MORE_FLAG) == 0;
-  l &= ~ ASN_PDU_FRAME_MORE_FLAG;
+static clib_error_t *
+asn_socket_rx_frame (asn_main_t * am, asn_socket_t * as, asn_pdu_frame_t * f, u32 n_frame_bytes)
+{
+  clib_error_t * error = 0;
+  u8 * data = f->user_data;
+  u32 n_user_data_bytes, is_last_frame;
 
-  if (vec_len (as->rx_frame) < l + sizeof (f->n_bytes_that_follow_and_more_flag_network_byte_order))
-    return 0;
+  is_last_frame = (clib_net_to_host_u16 (f->n_bytes_that_follow_and_more_flag_network_byte_order) & ASN_PDU_FRAME_MORE_FLAG) == 0;
+  n_user_data_bytes = n_frame_bytes - STRUCT_OFFSET_OF (asn_pdu_frame_t, user_data);
 
-  if (vec_len (as->rx_frame) > l + sizeof (f->n_bytes_that_follow_and_more_flag_network_byte_order))
+  /* Decrypt in place in receive buffer. */
+  if (crypto_box_open_detached_afternm (data, data, f->user_data_authentication, n_user_data_bytes,
+					as->ephemeral_crypto_state.nonce[ASN_RX],
+					as->ephemeral_crypto_state.shared_secret) < 0)
     {
-      error = clib_error_return (0, "frame length error frame %d websocket %d", l, n_payload_bytes);
+      error = clib_error_return (0, "authentication fails");
       goto done;
     }
+  asn_crypto_increment_nonce (as->ephemeral_crypto_state.nonce[ASN_RX], 2);
 
-  n_user_data_bytes = vec_len (as->rx_frame) - STRUCT_OFFSET_OF (asn_pdu_frame_t, user_data);
-  if (n_user_data_bytes > sizeof (f->user_data))
+  if (as->rx_blob_is_streaming)
     {
-      error = clib_error_return (0, "frame length too long %d", n_user_data_bytes);
+      asn_blob_handler_t * bh = &as->rx_blob_stream_handler;
+      error = bh->blob_type->stream_data (bh, data, n_user_data_bytes);
+      if (! error && is_last_frame)
+	{
+	  as->rx_blob_is_streaming = 0;
+	  error = bh->blob_type->stream_end (bh, /* is_abort */ 0);
+	}
       goto done;
     }
 
-  memset (crypto_box_buffer, 0, crypto_box_reserved_pad_authentication_offset);
-  memcpy (crypto_box_buffer + crypto_box_reserved_pad_authentication_offset,
-	  f->user_data_authentication,
-	  sizeof (f->user_data_authentication));
-  memcpy (crypto_box_buffer + crypto_box_reserved_pad_bytes, f->user_data, n_user_data_bytes);
+  if (as->rx_pdu_is_spilled)
+    {
+      error = asn_socket_rx_spill_data (as, data, n_user_data_bytes);
+      if (! error && is_last_frame)
+	{
+	  error = asn_socket_rx_spilled_pdu (am, as);
+	  asn_socket_rx_pdu_reset (as);
+	}
+      goto done;
+    }
 
-  if (crypto_box_open_afternm (crypto_box_buffer, crypto_box_buffer, crypto_box_reserved_pad_bytes + n_user_data_bytes,
-			       as->ephemeral_crypto_state.nonce[ASN_RX],
-			       as->ephemeral_crypto_state.shared_secret) < 0)
+  /* Single frame PDU: dispatch straight from receive buffer.  PDU may be at any alignment
+     (frames follow each other in websocket payload) so handlers must only cast it to packed
+     or byte array structs and copy out anything wider (e.g. mark_blob_handler). */
+  if (is_last_frame && vec_len (as->rx_pdu) == 0)
     {
-      error = clib_error_return (0, "authentication fails");
+      error = asn_socket_rx_pdu (am, as, (void *) data, n_user_data_bytes);
       goto done;
     }
-  asn_crypto_increment_nonce (as->ephemeral_crypto_state.nonce[ASN_RX], 2);
 
-  vec_add (as->rx_pdu, crypto_box_buffer + crypto_box_reserved_pad_bytes, n_user_data_bytes);
-  vec_reset_length (as->rx_frame);
+  vec_add (as->rx_pdu, data, n_user_data_bytes);
 
   if (! is_last_frame)
-    goto done;
-
-  if (vec_len (as->rx_pdu) < sizeof (asn_pdu_header_t))
     {
-      error = clib_error_return (0, "short pdu %d bytes", vec_len (as->rx_pdu));
+      error = asn_socket_rx_partial_pdu (am, as, n_user_data_bytes);
       goto done;
     }
 
-  asn_pdu_header_t * h = (void *) as->rx_pdu;
+  error = asn_socket_rx_pdu (am, as, (void *) as->rx_pdu, vec_len (as->rx_pdu));
+  vec_reset_length (as->rx_pdu);
 
-  if (am->verbose)
-    clib_warning ("%U", format_asn_pdu, am, h, vec_len (as->rx_pdu));
+ done:
+  return error;
+}
 
-  switch (h->id)
+/* Number of bytes in frame including control word given first 2 bytes of frame. */
+always_inline u32
+asn_pdu_frame_n_bytes (u8 * f)
+{
+  asn_pdu_frame_t * x = (void *) f;
+  u32 l = clib_net_to_host_u16 (x->n_bytes_that_follow_and_more_flag_network_byte_order);
+  return (l &~ ASN_PDU_FRAME_MORE_FLAG) + sizeof (x->n_bytes_that_follow_and_more_flag_network_byte_order);
+}
+
+static clib_error_t *
+asn_main_rx_frame_payload (websocket_main_t * wsm, websocket_socket_t * ws, u8 * rx_payload, u32 n_payload_bytes)
+{
+  asn_main_t * am = CONTAINER_OF (wsm, asn_main_t, websocket_main);
+  asn_socket_t * as = CONTAINER_OF (ws, asn_socket_t, websocket_socket);
+  clib_error_t * error = 0;
+  asn_pdu_frame_t * f;
+  u8 * rx_frame;
+  u32 n_frame_bytes, n_copy, l, is_server;
+  
+  is_server = websocket_connection_type (ws) == WEBSOCKET_CONNECTION_TYPE_server_client;
+
+  if (is_server && as->session_state == ASN_SESSION_STATE_opened)
     {
-#define _(f,n)								\
-      case ASN_PDU_##f:							\
-        error = asn_socket_rx_##f##_pdu (am, as, (void *) h, vec_len (as->rx_pdu)); \
-          if (error) goto done;						\
-          break;
+      as->session_state = ASN_SESSION_STATE_established;
+      if (n_payload_bytes != sizeof (as->ephemeral_keys.public))
+	{
+	  error = clib_error_return (0, "expected public key %d bytes received %d bytes",
+				     sizeof (as->ephemeral_keys.public), n_payload_bytes);
+	  goto done;
+	}
 
-      foreach_asn_pdu_id;
+      memcpy (as->ephemeral_crypto_state.nonce, am->server_nonce, sizeof (am->server_nonce));
+      crypto_box_beforenm (as->ephemeral_crypto_state.shared_secret, rx_payload, am->server_keys.private.encrypt_key);
 
-#undef _
+      /* FIXME ack with our ephemeral key and new nonce. */
 
-    default:
-      error = clib_error_return (0, "unknown pdu id 0x%x", h->id);
-      goto done;
+      if (am->verbose)
+	clib_warning ("handshake received; ephemeral received %U",
+		      format_hex_bytes, rx_payload, sizeof (as->ephemeral_keys.public));
+
+      return 0;
     }
 
-  vec_reset_length (as->rx_pdu);
+  /* Websocket payload may contain any number of frames (when peer coalesces)
+     and frames may span payloads. */
+  while (n_payload_bytes > 0)
+    {
+      l = vec_len (as->rx_frame);
+
+      /* Whole frame in payload: no need to copy. */
+      if (l == 0
+	  && n_payload_bytes >= sizeof (f->n_bytes_that_follow_and_more_flag_network_byte_order)
+	  && n_payload_bytes >= (n_frame_bytes = asn_pdu_frame_n_bytes (rx_payload)))
+	{
+	  rx_frame = rx_payload;
+	  rx_payload += n_frame_bytes;
+	  n_payload_bytes -= n_frame_bytes;
+	}
+
+      /* Otherwise collect partial frame. */
+      else
+	{
+	  n_frame_bytes = sizeof (f->n_bytes_that_follow_and_more_flag_network_byte_order);
+	  if (l >= n_frame_bytes)
+	    n_frame_bytes = asn_pdu_frame_n_bytes (as->rx_frame);
+	  n_copy = clib_min (n_frame_bytes - l, n_payload_bytes);
+	  vec_add (as->rx_frame, rx_payload, n_copy);
+	  rx_payload += n_copy;
+	  n_payload_bytes -= n_copy;
+	  /* Header just completed: go back for frame length unless frame is header only
+	     (which is too short and rejected below). */
+	  if (vec_len (as->rx_frame) == sizeof (f->n_bytes_that_follow_and_more_flag_network_byte_order)
+	      && asn_pdu_frame_n_bytes (as->rx_frame) > vec_len (as->rx_frame))
+	    continue;
+	  if (vec_len (as->rx_frame) < n_frame_bytes)
+	    break;
+	  rx_frame = as->rx_frame;
+	}
+
+      if (n_frame_bytes < STRUCT_OFFSET_OF (asn_pdu_frame_t, user_data))
+	{
+	  error = clib_error_return (0, "frame length too short %d", n_frame_bytes);
+	  goto done;
+	}
+
+      if (n_frame_bytes > (STRUCT_OFFSET_OF (asn_pdu_frame_t, user_data)
+			   + asn_pdu_frame_max_user_data_bytes (asn_main_rx_log2_max_frame_bytes (am))))
+	{
+	  error = clib_error_return (0, "frame length too long %d", n_frame_bytes);
+	  goto done;
+	}
+
+      error = asn_socket_rx_frame (am, as, (void *) rx_frame, n_frame_bytes);
+      vec_reset_length (as->rx_frame);
+      if (error)
+	goto done;
+    }
 
  done:
   if (error)
     {
-      vec_reset_length (as->rx_pdu);
+      asn_socket_rx_pdu_reset (as);
       vec_reset_length (as->rx_frame);
     }
   return error;
@@ -1386,7 +2488,7 @@ clib_error_t * asn_request_new_user_with_type (asn_main_t * am, asn_socket_t * a
 clib_error_t * asn_socket_login_for_user (asn_main_t * am, asn_socket_t * as, asn_user_t * au)
 {
   asn_pdu_login_t * l;
-  l = asn_socket_tx_add_pdu (as, ASN_PDU_login, sizeof (l[0]));
+  l = asn_socket_tx_add_pdu (am, as, ASN_PDU_login, sizeof (l[0]));
   memcpy (l->key, au->crypto_keys.public.encrypt_key, sizeof (l->key));
   memcpy (l->signature, au->crypto_keys.public.self_signed_encrypt_key, sizeof (l->signature));
   l->header.login_request_id.user_type_index = au->user_type_index;
@@ -1403,7 +2505,7 @@ clib_error_t * asn_socket_login_for_user (asn_main_t * am, asn_socket_t * as, as
     cs->self_user_login_in_progress = 1;
   }
 
-  return asn_socket_tx (as);
+  return asn_socket_tx (am, as);
 }
 
 static void
@@ -1443,27 +2545,34 @@ asn_register_blob_type (asn_main_t * am, asn_blob_type_t * bt)
     }
 }
 
+/* Exec command for blob save up to start of contents. */
+static u8 *
+asn_format_blob_save_command (u8 * s, asn_user_t * au, u8 * path)
+{
+  return format (s, "blob%c~%U/%v%c-%c%c", 0,
+		 format_hex_bytes, au->crypto_keys.public.encrypt_key, sizeof (au->crypto_keys.public.encrypt_key),
+		 path,
+		 0, 0, 0);
+}
+
 clib_error_t *
 asn_save_blob_with_contents (asn_main_t * am, asn_socket_t * as, asn_user_t * au, u8 * blob_contents,
                              char * fmt, ...)
 {
   clib_error_t * error;
-  u8 * path;
+  u8 * path, * cmd;
   va_list va;
 
   va_start (va, fmt);
   path = va_format (0, fmt, &va);
   va_end (va);
 
-  error = asn_socket_exec_with_ack_handler
-    (am, as, /* ack handler */ 0,
-     "blob%c~%U/%v%c-%c%c%v", 0,
-     format_hex_bytes, au->crypto_keys.public.encrypt_key, sizeof (au->crypto_keys.public.encrypt_key),
-     path,
-     0, 0, 0,
-     blob_contents);
+  /* Contents are copied straight into PDU frames. */
+  cmd = asn_format_blob_save_command (0, au, path);
+  error = asn_exec_command_with_contents (am, as, /* ack handler */ 0, cmd, blob_contents);
 
   vec_free (path);
+  vec_free (cmd);
 
   return error;
 }
@@ -1473,7 +2582,7 @@ asn_save_serialized_blob (asn_main_t * am, asn_socket_t * as, asn_user_t * au, c
 {
   serialize_main_t m;
   clib_error_t * error;
-  u8 * path, * blob_contents;
+  u8 * path, * cmd, * blob_contents;
   va_list va;
 
   va_start (va, fmt);
@@ -1483,13 +2592,12 @@ asn_save_serialized_blob (asn_main_t * am, asn_socket_t * as, asn_user_t * au, c
   blob_contents = serialize_close_vector (&m);
   va_end (va);
 
-  error = asn_socket_exec_with_ack_handler
-    (am, as, /* ack handler */ 0,
-     "blob%c~%U/%v%c-%c%c%v", 0,
-     format_hex_bytes, au->crypto_keys.public.encrypt_key, sizeof (au->crypto_keys.public.encrypt_key),
-     path,
-     0, 0, 0,
-     blob_contents);
+  if (! error)
+    {
+      cmd = asn_format_blob_save_command (0, au, path);
+      error = asn_exec_command_with_contents (am, as, /* ack handler */ 0, cmd, blob_contents);
+      vec_free (cmd);
+    }
 
   vec_free (path);
   vec_free (blob_contents);
@@ -1497,6 +2605,46 @@ asn_save_serialized_blob (asn_main_t * am, asn_socket_t * as, asn_user_t * au, c
   return error;
 }
 
+clib_error_t *
+asn_save_blob_with_writer (asn_main_t * am, asn_socket_t * as, asn_user_t * au, asn_blob_writer_t * bw, char * fmt, ...)
+{
+  clib_error_t * error = 0;
+  asn_client_socket_t * cs;
+  u8 * path = 0, * cmd = 0;
+  va_list va;
+
+  /* Contents are read once so they can only go to a single socket. */
+  if (! as)
+    vec_foreach (cs, am->client_sockets)
+      {
+	if (cs->socket_index == ~0)
+	  continue;
+	as = asn_socket_at_index (am, cs->socket_index);
+	if (as->session_state == ASN_SESSION_STATE_established)
+	  break;
+	as = 0;
+      }
+
+  if (! as)
+    {
+      error = clib_error_return (0, "no established socket for blob");
+      asn_blob_writer_free (bw);
+      goto done;
+    }
+
+  va_start (va, fmt);
+  path = va_format (0, fmt, &va);
+  va_end (va);
+
+  cmd = asn_format_blob_save_command (0, au, path);
+  error = asn_socket_exec_command (am, as, /* ack handler */ 0, cmd, /* contents */ 0, bw);
+
+ done:
+  vec_free (path);
+  vec_free (cmd);
+  return error;
+}
+
 clib_error_t *
 asn_unserialize_blob_contents (asn_main_t * am, asn_pdu_blob_t * blob, u32 n_bytes_in_pdu, ...)
 {
@@ -1525,6 +2673,9 @@ clib_error_t * asn_poll_for_input (asn_main_t * am, f64 timeout)
   websocket_socket_t * ws;
   f64 now;
 
+  /* Queue PDUs generated while handling input and send them together at the end. */
+  asn_main_cork (am);
+
   am->unix_file_poller.poll_for_input (&am->unix_file_poller, timeout);
 
   websocket_close_all_sockets_with_no_handshake (&am->websocket_main);
@@ -1581,6 +2732,14 @@ clib_error_t * asn_poll_for_input (asn_main_t * am, f64 timeout)
     }
 
  done:
+  {
+    clib_error_t * tx_error = asn_main_uncork (am);
+    if (! error)
+      error = tx_error;
+    else if (tx_error)
+      clib_error_report (tx_error);
+  }
+
   return error;
 }
 
@@ -1678,10 +2837,15 @@ static clib_error_t * mark_blob_handler (asn_blob_handler_t * bh, asn_pdu_blob_t
 {
   asn_main_t * am = bh->asn_main;
   clib_error_t * error = 0;
-  asn_user_mark_response_t * r = asn_pdu_contents_for_blob (blob);
+  asn_user_mark_response_t _r, * r = &_r;
   asn_user_t * au;
   asn_user_type_t * ut;
 
+  /* Blob may be at any alignment in receive buffer: copy out response (which has i32 fields). */
+  if (asn_pdu_n_content_bytes_for_blob (blob, n_bytes_in_pdu) < sizeof (r[0]))
+    return clib_error_return (0, "mark blob too short %d bytes", asn_pdu_n_content_bytes_for_blob (blob, n_bytes_in_pdu));
+  memcpy (r, asn_pdu_contents_for_blob (blob), sizeof (r[0]));
+
   if (am->verbose)
     clib_warning ("%U", format_asn_user_mark_response, r);
 		
@@ -1849,11 +3013,23 @@ void asn_socket_free (asn_socket_t * as)
 {
   asn_pdu_t * p;
 
+  as->tx_cork_count = 0;
+  as->tx_is_pending = 0;
+  as->tx_n_bytes_in_websocket_frame = 0;
+  as->tx_log2_frame_bytes = 0;
+
+  asn_socket_rx_pdu_reset (as);
   vec_free (as->rx_pdu);
   vec_free (as->rx_frame);
   vec_foreach (p, as->tx_pdus)
     asn_pdu_free (p);
   vec_free (as->tx_pdus);
+  if (as->tx_frame_cache)
+    {
+      asn_pdu_frame_cache_free (as->tx_frame_cache);
+      clib_mem_free (as->tx_frame_cache);
+      as->tx_frame_cache = 0;
+    }
 
   {
     uword i;
@@ -1896,16 +3072,8 @@ void asn_main_free (asn_main_t * am)
     int i;
     for (i = 0; i < ARRAY_LEN (am->user_ref_by_public_encrypt_key); i++)
       {
-	hash_pair_t * p;
-	hash_free (am->user_ref_by_public_encrypt_key[i]);
-	hash_foreach_pair (p, am->user_ref_by_public_encrypt_key_first_7_bytes[i], ({
-	  asn_user_hash_value_free (p->value[0]);
-	}));
-	hash_free (am->user_ref_by_public_encrypt_key_first_7_bytes[i]);
-	hash_foreach_pair (p, am->user_ref_by_public_encrypt_key_first_8_bytes[i], ({
-	  asn_user_hash_value_free (p->value[0]);
-	}));
-	hash_free (am->user_ref_by_public_encrypt_key_first_8_bytes[i]);
+	asn_user_key_table_free (&am->user_ref_by_public_encrypt_key[i]);
+	asn_user_key_prefix_index_free (&am->user_ref_by_public_encrypt_key_prefix[i]);
       }
   }
   {
@@ -1922,6 +3090,9 @@ void asn_main_free (asn_main_t * am)
       asn_client_socket_free (cs);
     vec_free (am->client_sockets);
   }
+  vec_free (am->tx_pending_socket_indices);
+  vec_free (am->tx_flush_socket_indices);
+  vec_free (am->tx_exec_command_buffer);
   unix_file_poller_free (&am->unix_file_poller);
 }
 
@@ -2019,19 +3190,36 @@ void unserialize_asn_user_type (serialize_main_t * m, va_list * va)
   asn_user_type_t * t = va_arg (*va, asn_user_type_t *);
   unserialize (m, unserialize_pool, &t->user_pool, t->user_type_n_bytes, t->unserialize_pool_users);
 
+  /* Index all users in one pass with indices sized once. */
   {
+    asn_user_key_table_t * kt = &am->user_ref_by_public_encrypt_key[ASN_TX];
+    asn_user_key_prefix_index_elt_t * elts = 0, * e;
+    asn_user_ref_t r;
     void * u;
     uword i;
+
+    asn_user_key_table_resize (kt, kt->n_elts + pool_elts (t->user_pool));
+
     u = t->user_pool;
     vec_foreach_index (i, t->user_pool)
       {
         if (! pool_is_free_index (t->user_pool, i))
           {
             asn_user_t * au = u + t->user_type_offset_of_asn_user;
-            asn_user_hash_by_public_key (am, ASN_TX, au);
+            au->last_use = ++am->user_use_count;
+            asn_user_key_table_set (kt, au);
+
+            r.type_index = au->user_type_index;
+            r.user_index = au->index;
+            vec_add2 (elts, e, 1);
+            e->key_prefix = asn_user_key_prefix (au->crypto_keys.public.encrypt_key);
+            e->user_ref_as_uword = asn_user_ref_as_uword (&r);
           }
         u += t->user_type_n_bytes;
       }
+
+    asn_user_key_prefix_index_add_multiple (&am->user_ref_by_public_encrypt_key_prefix[ASN_TX], elts);
+    vec_free (elts);
   }
 }
 
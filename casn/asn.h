@@ -4,6 +4,10 @@
 #include <uclib/uclib.h>
 #include <casn/tweetnacl.h>
 
+#if defined (__AVX2__) || defined (__SSE2__)
+#include <x86intrin.h>
+#endif
+
 typedef struct {
   u8 auth_key[crypto_sign_private_key_bytes];
   u8 encrypt_key[crypto_box_private_key_bytes];
@@ -21,6 +25,31 @@ typedef struct {
   u8 data[crypto_box_public_key_bytes];
 } asn_user_key_t;
 
+/* Public keys are uniformly random so any 8 of their bytes already make a good hash.
+   Keys may be at any alignment (e.g. inside PDUs). */
+always_inline u64
+asn_user_key_fingerprint (u8 * key)
+{ return clib_mem_unaligned (key, u64); }
+
+always_inline uword
+asn_user_keys_are_equal (u8 * k0, u8 * k1)
+{
+#if defined (__AVX2__)
+  __m256i x = _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((__m256i *) k0), _mm256_loadu_si256 ((__m256i *) k1));
+  return _mm256_movemask_epi8 (x) == ~0;
+#elif defined (__SSE2__)
+  __m128i x0 = _mm_cmpeq_epi8 (_mm_loadu_si128 ((__m128i *) k0), _mm_loadu_si128 ((__m128i *) k1));
+  __m128i x1 = _mm_cmpeq_epi8 (_mm_loadu_si128 ((__m128i *) k0 + 1), _mm_loadu_si128 ((__m128i *) k1 + 1));
+  return _mm_movemask_epi8 (_mm_and_si128 (x0, x1)) == 0xffff;
+#else
+  u64 d = 0;
+  uword i;
+  for (i = 0; i < crypto_box_public_key_bytes; i += sizeof (u64))
+    d |= clib_mem_unaligned (k0 + i, u64) ^ clib_mem_unaligned (k1 + i, u64);
+  return d == 0;
+#endif
+}
+
 typedef struct {
   asn_crypto_private_keys_t private;
   asn_crypto_public_keys_t public;
@@ -92,8 +121,8 @@ typedef enum {
   ASN_N_PDU,
 } asn_pdu_id_t;
 
-/* PDUs are broken up into frames of at most 4094 bytes preceeded by a u16 control word
-   followed by 16 bytes of poly1305 authentication. */
+/* PDUs are broken up into frames of at most 4096 bytes (by default) preceeded by a u16 control word.
+   Frame is 16 bytes of poly1305 authentication followed by user data. */
 typedef CLIB_PACKED (struct {
   /* More flag indicates more segments follow else end of PDU. */
 #define ASN_PDU_FRAME_LOG2_MORE_FLAG (15)
@@ -108,13 +137,27 @@ typedef CLIB_PACKED (struct {
   /* 16 byte poly1305 authenticator for user data. */
   u8 user_data_authentication[crypto_box_authentication_bytes];
 
-  /* Up to 4096 - 16 bytes of user data follow. */
-  u8 user_data[4096 - crypto_box_authentication_bytes];
+  /* Up to frame size - 16 bytes of user data follow. */
+  u8 user_data[0];
 }) asn_pdu_frame_t;
 
+/* Frame size (bytes following control word) is 4096 unless both sides advertise
+   larger frames in PDU header version.  Control word limits frames to 32k - 1 bytes. */
+#define ASN_PDU_FRAME_LOG2_DEFAULT_BYTES 12
+#define ASN_PDU_FRAME_LOG2_MAX_BYTES 15
+
+always_inline u32
+asn_pdu_frame_max_user_data_bytes (u32 log2_frame_bytes)
+{
+  u32 n = clib_min (1 << log2_frame_bytes, ASN_PDU_FRAME_MORE_FLAG - 1);
+  return n - crypto_box_authentication_bytes;
+}
+
 typedef CLIB_PACKED (struct {
-  /* ASN version: set to 0. */
+  /* ASN version.  Low 4 bits are log2 of largest frame sender can receive minus 12
+     (zero for 4k frames); other bits are zero. */
   u8 version;
+#define ASN_PDU_VERSION_LOG2_FRAME_BYTES_MASK 0xf
 
   /* PDU id. */
   asn_pdu_id_t id : 8;
@@ -230,6 +273,7 @@ asn_pdu_n_content_bytes_for_blob (asn_pdu_blob_t * b, u32 n_bytes_in_pdu)
 }
 
 struct asn_user_t;
+struct asn_main_t;
 
 typedef struct {
   char * name;
@@ -249,6 +293,9 @@ typedef struct {
   /* Function to free a pool element. */
   void (* free_user) (struct asn_user_t * au);
 
+  /* Called before user is deleted to drop references held outside of user pool. */
+  void (* will_delete_user) (struct asn_main_t * am, struct asn_user_t * au);
+
   /* Pool serialize/unserialize functions. */
   serialize_function_t * serialize_pool_users, * unserialize_pool_users;
 
@@ -443,6 +490,10 @@ typedef struct asn_user_t
 
   /* Bitmap to indicate whether above array indices are valid. */
   uword * crypto_state_by_user_index_is_valid_bitmap;
+
+  /* Value of asn_main_t user_use_count when user was last indexed or found by key;
+     eviction deletes least recently used users first. */
+  u64 last_use;
 } asn_user_t;
 
 always_inline void
@@ -471,16 +522,108 @@ always_inline uword
 asn_user_is_owned_by_self (asn_user_t * au)
 { return au->is_self_owned; }
 
-always_inline void
-asn_user_del (asn_user_t * au)
-{
-  ASSERT (0);
-}
-
 always_inline asn_user_type_t *
 asn_user_type_for_user (asn_user_t * au)
 { return pool_elt (asn_user_type_pool, au->user_type_index); }
 
+/* Open addressing (linear probe) table mapping public encrypt key to user reference.
+   First 8 key bytes are kept inline as fingerprint so probes never touch user pools;
+   full key is compared against user only on fingerprint match. */
+typedef struct {
+  u64 key_fingerprint;
+
+  /* As returned by asn_user_ref_as_uword; ~0 marks empty slot. */
+  uword user_ref_as_uword;
+} asn_user_key_table_slot_t;
+
+typedef struct {
+  /* Vector of slots; length is power of 2 or zero. */
+  asn_user_key_table_slot_t * slots;
+
+  /* Random odd multiplier: peers choose keys so they must not choose slots. */
+  u64 hash_multiplier;
+
+  u32 log2_n_slots;
+
+  u32 n_elts;
+} asn_user_key_table_t;
+
+always_inline uword
+asn_user_key_table_slot_index (asn_user_key_table_t * t, u64 fingerprint)
+{ return (fingerprint * t->hash_multiplier) >> (64 - t->log2_n_slots); }
+
+always_inline asn_user_key_table_slot_t *
+asn_user_key_table_get (asn_user_key_table_t * t, u8 * key)
+{
+  asn_user_key_table_slot_t * s;
+  u64 f;
+  uword i, mask;
+
+  if (t->n_elts == 0)
+    return 0;
+
+  f = asn_user_key_fingerprint (key);
+  mask = vec_len (t->slots) - 1;
+  i = asn_user_key_table_slot_index (t, f);
+  while (1)
+    {
+      s = t->slots + i;
+      if (s->user_ref_as_uword == ~0)
+	return 0;
+      if (s->key_fingerprint == f)
+	{
+	  asn_user_t * au = asn_user_by_ref_as_uword (s->user_ref_as_uword);
+	  if (au && asn_user_keys_are_equal (au->crypto_keys.public.encrypt_key, key))
+	    return s;
+	}
+      i = (i + 1) & mask;
+    }
+}
+
+void asn_user_key_table_resize (asn_user_key_table_t * t, uword n_elts);
+void asn_user_key_table_set (asn_user_key_table_t * t, asn_user_t * au);
+void asn_user_key_table_unset (asn_user_key_table_t * t, asn_user_key_table_slot_t * s);
+void asn_user_key_table_free (asn_user_key_table_t * t);
+
+/* Users sorted by public encrypt key to answer key prefix queries of any length.
+   Incremental inserts go to a small sorted vector which becomes a run when full;
+   bulk inserts are sorted into a run directly.  Runs are merged so their sizes
+   at least double from newest to oldest: O(log N) runs to search and each
+   element is merged O(log N) times.  Deletes mark run elements in place. */
+typedef struct {
+  /* First 8 key bytes in network byte order so integer order is key order. */
+  u64 key_prefix;
+
+  uword user_ref_as_uword;
+} asn_user_key_prefix_index_elt_t;
+
+typedef struct {
+  /* Sorted runs, oldest first; each at least twice as long as the next. */
+  asn_user_key_prefix_index_elt_t ** runs;
+
+  /* Number of elements in runs including deleted ones.  Runs are compacted
+     when more than half are deleted. */
+  uword n_run_elts;
+  uword n_deleted_run_elts;
+
+  asn_user_key_prefix_index_elt_t * recent;
+} asn_user_key_prefix_index_t;
+
+#define ASN_USER_KEY_PREFIX_INDEX_MAX_RECENT 1024
+
+/* Set in user_ref_as_uword of deleted run elements. */
+#define ASN_USER_KEY_PREFIX_INDEX_DELETED ((uword) 1 << (BITS (uword) - 1))
+
+always_inline u64
+asn_user_key_prefix (u8 * key)
+{ return clib_net_to_host_u64 (clib_mem_unaligned (key, u64)); }
+
+void asn_user_key_prefix_index_add (asn_user_key_prefix_index_t * x, u8 * key, uword user_ref_as_uword);
+void asn_user_key_prefix_index_add_multiple (asn_user_key_prefix_index_t * x, asn_user_key_prefix_index_elt_t * elts);
+void asn_user_key_prefix_index_del (asn_user_key_prefix_index_t * x, u8 * key, uword user_ref_as_uword);
+void asn_user_key_prefix_index_del_multiple (asn_user_key_prefix_index_t * x, asn_user_key_prefix_index_elt_t * elts);
+void asn_user_key_prefix_index_free (asn_user_key_prefix_index_t * x);
+
 #define foreach_asn_session_state               \
   _ (opened)					\
   _ (provisional)                               \
@@ -496,24 +639,98 @@ typedef enum {
   ASN_N_SESSION_STATE,
 } asn_session_state_t;
 
+struct asn_blob_writer_t;
+
+/* Fill up to N_BYTES of blob contents into DATA.  Setting *N_BYTES_READ to zero ends blob. */
+typedef clib_error_t * (asn_blob_writer_read_function_t) (struct asn_blob_writer_t * bw, u8 * data, u32 n_bytes, u32 * n_bytes_read);
+
+/* Source of blob contents streamed into frames as socket transmit space allows. */
+typedef struct asn_blob_writer_t {
+  /* Reads contents; default reads from file descriptor. */
+  asn_blob_writer_read_function_t * read_function;
+
+  /* File descriptor for default read function or ~0.  Closed when writer is freed. */
+  int file_descriptor;
+
+  u32 container_offset_of_object;
+
+  /* Number of content bytes read so far. */
+  u64 n_bytes_read;
+
+  void (* free) (struct asn_blob_writer_t * bw);
+} asn_blob_writer_t;
+
+always_inline void *
+asn_blob_writer_create_with_function_in_container (asn_blob_writer_read_function_t * f, uword sizeof_object, uword object_offset_of_blob_writer)
+{
+  asn_blob_writer_t * bw = clib_mem_alloc_in_container (sizeof (bw[0]), sizeof_object, object_offset_of_blob_writer);
+  memset (bw, 0, sizeof (bw[0]));
+  bw->read_function = f;
+  bw->file_descriptor = ~0;
+  bw->container_offset_of_object = object_offset_of_blob_writer;
+  return (void *) bw - object_offset_of_blob_writer;
+}
+
+/* Writer for contents read from given (blocking) file descriptor until end of file. */
+asn_blob_writer_t * asn_blob_writer_create_for_file_descriptor (int fd);
+
+void asn_blob_writer_free (asn_blob_writer_t * bw);
+
+/* Frame buffers (and frame vectors) of freed PDUs kept for re-use so that steady state
+   transmit does no memory allocation. */
+typedef struct {
+  asn_pdu_frame_t ** free_frames;
+
+  /* Frame vectors with zero length. */
+  asn_pdu_frame_t *** free_frame_vectors;
+
+  /* Size of all frames on free list. */
+  u32 max_user_data_bytes_per_frame;
+
+  /* Number of frames allocated/freed with clib_mem and taken from free list. */
+  u64 n_frame_allocs;
+  u64 n_frame_frees;
+  u64 n_frame_reuses;
+} asn_pdu_frame_cache_t;
+
+/* At most this many frames are kept on free list. */
+#define ASN_PDU_FRAME_CACHE_MAX_FRAMES 32
+
+/* Counts allocs/frees of frames for PDUs with no cache (free list is never used). */
+extern asn_pdu_frame_cache_t asn_pdu_uncached_frame_counts;
+
+void asn_pdu_frame_cache_free (asn_pdu_frame_cache_t * c);
+format_function_t format_asn_pdu_frame_cache;
+
+/* PDU under construction: a chain of frame buffers.
+   All frames but the last are normally full. */
 typedef struct {
-  /* Full frames preceeding last frame. */
-  asn_pdu_frame_t * full_frames;
+  /* Frames in transmit order.  User data is clear text and each frame's user data
+     byte count is kept in its control word until frame is encrypted into socket's transmit buffer. */
+  asn_pdu_frame_t ** frames;
 
-  u32 n_user_bytes_in_last_frame;
+  /* Size of frames for socket PDU is built for; zero for default 4k frames. */
+  u32 max_user_data_bytes_per_frame;
 
-  asn_pdu_frame_t last_frame;
+  /* Frames are allocated from and freed to this cache when set. */
+  asn_pdu_frame_cache_t * frame_cache;
 
-  /* Vector of data which spans frames. */
-  u8 * overflow_data;
+  /* When set rest of PDU is read from writer at transmit time
+     reusing last frame buffer. */
+  asn_blob_writer_t * blob_writer;
 } asn_pdu_t;
 
+void asn_pdu_free (asn_pdu_t * p);
+
+/* Reserve contiguous zeroed space at end of PDU.  Starts a new frame when space does not fit in last frame. */
+void * asn_pdu_reserve (asn_pdu_t * p, u32 n_bytes);
+
+/* Append data to PDU writing across frame boundaries. */
+void asn_pdu_append (asn_pdu_t * p, void * data, uword n_bytes);
+
 always_inline void
-asn_pdu_free (asn_pdu_t * p) 
-{
-  vec_free (p->full_frames);
-  vec_free (p->overflow_data);
-}
+asn_pdu_append_vec (asn_pdu_t * p, u8 * v)
+{ asn_pdu_append (p, v, vec_len (v)); }
 
 struct asn_main_t;
 struct asn_socket_t;
@@ -527,6 +744,10 @@ typedef struct asn_exec_ack_handler_t {
   u32 container_offset_of_object;
   asn_exec_ack_handler_function_t * function;
   void (* free) (struct asn_exec_ack_handler_t * ah, u32 is_force);
+
+  /* Optional: adds indices of users of given type this handler refers to until its ack arrives
+     so that asn_users_evict will not delete them. */
+  uword * (* keep_users) (struct asn_exec_ack_handler_t * ah, u32 user_type_index, uword * keep_user_bitmap);
 } asn_exec_ack_handler_t;
 
 always_inline void *
@@ -534,6 +755,7 @@ asn_exec_ack_handler_create_with_function_in_container (asn_exec_ack_handler_fun
 {
   asn_exec_ack_handler_t * ah = clib_mem_alloc_in_container (sizeof (ah[0]), sizeof_object, object_offset_of_ack_handler);
   ah->function = f;
+  ah->keep_users = 0;
   ah->container_offset_of_object = object_offset_of_ack_handler;
   return (void *) ah - object_offset_of_ack_handler;
 }
@@ -542,45 +764,29 @@ always_inline asn_exec_ack_handler_t *
 asn_exec_ack_handler_create_with_function (asn_exec_ack_handler_function_t * f)
 { return asn_exec_ack_handler_create_with_function_in_container (f, sizeof (asn_exec_ack_handler_t), /* object_offset_of_ack_handler */ 0); }
 
-typedef struct asn_socket_t {
-  websocket_socket_t websocket_socket;
-
-  /* PDUs to be combined into a single websocket data frame. */
-  asn_pdu_t * tx_pdus;
-
-  /* Currently received PDU we're working on. */
-  u8 * rx_pdu;
-
-  /* Current frame we're working on. */
-  u8 * rx_frame;
-
-  asn_crypto_ephemeral_keys_t ephemeral_keys;
-
-  /* Nonce and shared secret. */
-  asn_crypto_state_t ephemeral_crypto_state;
-
-  asn_exec_ack_handler_t ** exec_ack_handler_pool;
-
-  asn_session_state_t session_state;
-
-  u32 client_socket_index;
-
-  u32 exec_sequence_number;
-} asn_socket_t;
-
-void asn_socket_free (asn_socket_t * as);
-
-
 struct asn_blob_handler_t;
 typedef clib_error_t * (asn_blob_handler_function_t) (struct asn_blob_handler_t * h,
                                                       asn_pdu_blob_t * blob,
                                                       u32 n_bytes_in_pdu);
 
+/* Streaming receive: begin is called with blob header and name (contents not included),
+   data with contents as each frame arrives and end when last frame arrives or receive is aborted. */
+typedef clib_error_t * (asn_blob_stream_begin_function_t) (struct asn_blob_handler_t * h, asn_pdu_blob_t * blob);
+typedef clib_error_t * (asn_blob_stream_data_function_t) (struct asn_blob_handler_t * h, u8 * data, u32 n_data_bytes);
+typedef clib_error_t * (asn_blob_stream_end_function_t) (struct asn_blob_handler_t * h, u32 is_abort);
+
 typedef struct {
   u32 index;
   u8 * name;                    /* formatted name as vector for hash lookup. */
   char * path;                  /* path to initialize. */
   asn_blob_handler_function_t * handler;
+
+  /* Optional streaming receive for multi-frame blobs; handler is still used for single frame blobs.
+     Without these large PDUs are spilled to a memory-mapped temporary file. */
+  asn_blob_stream_begin_function_t * stream_begin;
+  asn_blob_stream_data_function_t * stream_data;
+  asn_blob_stream_end_function_t * stream_end;
+
   /* Time stamp of most recent blob of this type per user type and user index.
      most_recent_time_stamp_in_nsec_from_1970_for_user_type_and_index[user_type][user_index]; */
   u64 ** most_recent_time_stamp_in_nsec_from_1970_for_user_type_and_index;
@@ -625,8 +831,70 @@ typedef struct asn_blob_handler_t {
   struct asn_main_t * asn_main;
   struct asn_socket_t * asn_socket;
   asn_blob_type_t * blob_type;
+
+  /* For stream functions to keep state between calls. */
+  uword opaque;
 } asn_blob_handler_t;
 
+typedef struct asn_socket_t {
+  websocket_socket_t websocket_socket;
+
+  /* PDUs to be combined into a single websocket data frame. */
+  asn_pdu_t * tx_pdus;
+
+  /* Frame buffers for re-use by tx_pdus.  Allocated separately since PDUs
+     point to it and socket pool may move. */
+  asn_pdu_frame_cache_t * tx_frame_cache;
+
+  /* Currently received PDU we're working on. */
+  u8 * rx_pdu;
+
+  /* Current frame we're working on. */
+  u8 * rx_frame;
+
+  /* Blob PDU being received with blob type's stream functions. */
+  asn_blob_handler_t rx_blob_stream_handler;
+  u32 rx_blob_is_streaming;
+
+  /* Large PDU being received is written to (unlinked) temporary file instead of rx_pdu. */
+  u32 rx_pdu_is_spilled;
+  int rx_pdu_spill_fd;
+  u64 rx_pdu_n_spill_bytes;
+
+  asn_crypto_ephemeral_keys_t ephemeral_keys;
+
+  /* Nonce and shared secret. */
+  asn_crypto_state_t ephemeral_crypto_state;
+
+  asn_exec_ack_handler_t ** exec_ack_handler_pool;
+
+  asn_session_state_t session_state;
+
+  u32 client_socket_index;
+
+  u32 exec_sequence_number;
+
+  /* Number of bytes of encrypted ASN frames in socket's transmit buffer not yet sent
+     as a websocket data frame. */
+  u32 tx_n_bytes_in_websocket_frame;
+
+  /* Log2 frame size for transmit: smaller of ours and size peer advertised in
+     PDU version.  Zero until peer's first PDU (4k frames). */
+  u32 tx_log2_frame_bytes;
+
+  /* Non-zero when socket is corked: PDUs are queued until uncorked. */
+  u32 tx_cork_count;
+
+  /* Set when PDUs are queued on corked socket. */
+  u32 tx_is_pending;
+} asn_socket_t;
+
+void asn_socket_free (asn_socket_t * as);
+
+always_inline void
+asn_socket_cork (asn_socket_t * as)
+{ as->tx_cork_count++; }
+
 typedef enum {
 #define foreach_asn_socket_type _ (websocket) _ (tcp)
 #define _(f) ASN_SOCKET_TYPE_##f,
@@ -674,12 +942,44 @@ typedef struct asn_main_t {
 
   u32 verbose;
 
+  /* Encrypted ASN frames are packed into websocket data frames of up to this many bytes.
+     Zero sends one websocket frame per ASN frame. */
+  u32 tx_coalesce_max_websocket_frame_bytes;
+
+  /* Non-zero when all sockets are corked (e.g. while asn_poll_for_input runs).
+     Queued PDUs are flushed when count returns to zero. */
+  u32 tx_cork_count;
+
+  /* Sockets with PDUs queued while corked or with blob writers waiting for transmit space. */
+  u32 * tx_pending_socket_indices;
+
+  /* Log2 of largest frame we accept (and advertise to peers); 12 through 15.
+     Zero means ASN_PDU_FRAME_LOG2_DEFAULT_BYTES (4k). */
+  u32 rx_log2_max_frame_bytes;
+
+  /* Received PDUs larger than this are spilled to temporary file.
+     Zero means ASN_RX_PDU_DEFAULT_SPILL_BYTES. */
+  u32 rx_pdu_spill_bytes;
+
+  /* Exec commands are formatted here; kept to avoid re-allocation. */
+  u8 * tx_exec_command_buffer;
+
+  /* Pending indices vector being flushed; kept to avoid re-allocation. */
+  u32 * tx_flush_socket_indices;
+
+
+  /* Blob writers stop reading while this many bytes are buffered for transmit on socket.
+     Zero means ASN_BLOB_WRITER_DEFAULT_MAX_TX_BUFFER_BYTES. */
+  u32 tx_blob_writer_max_buffer_bytes;
+
   /* Index and user type of self user. */
   asn_user_ref_t self_user_ref;
 
-  uword * user_ref_by_public_encrypt_key[ASN_N_RX_TX];
-  uword * user_ref_by_public_encrypt_key_first_7_bytes[ASN_N_RX_TX];
-  uword * user_ref_by_public_encrypt_key_first_8_bytes[ASN_N_RX_TX];
+  asn_user_key_table_t user_ref_by_public_encrypt_key[ASN_N_RX_TX];
+  asn_user_key_prefix_index_t user_ref_by_public_encrypt_key_prefix[ASN_N_RX_TX];
+
+  /* Counts users found by key; clock for least recently used eviction. */
+  u64 user_use_count;
 
   asn_blob_type_t ** blob_types;
 
@@ -706,71 +1006,20 @@ asn_is_user_for_ref (asn_user_t * au, asn_user_ref_t * r)
 always_inline asn_user_t *
 asn_user_with_encrypt_key (asn_main_t * am, asn_rx_or_tx_t rt, u8 * encrypt_key)
 {
-  uword * p;
-
-  /* Hash requires aligned address for key. */
-  union {
-    uword as_uword[crypto_box_public_key_bytes / sizeof (uword)];
-    u8 as_u8[crypto_box_public_key_bytes];
-  } aligned_encrypt_key;
-  if (pointer_to_uword (encrypt_key) % 2)
-    {
-      memcpy (aligned_encrypt_key.as_u8, encrypt_key, sizeof (aligned_encrypt_key.as_u8));
-      encrypt_key = aligned_encrypt_key.as_u8;
-    }
-  ASSERT (pointer_to_uword (encrypt_key) % 2 == 0);
-
-  if (am->user_ref_by_public_encrypt_key[rt]
-      && (p = hash_get_mem (am->user_ref_by_public_encrypt_key[rt], encrypt_key)))
-    return asn_user_by_ref_as_uword (p[0]);
-  else
+  asn_user_key_table_slot_t * s = asn_user_key_table_get (&am->user_ref_by_public_encrypt_key[rt], encrypt_key);
+  asn_user_t * au;
+  if (! s)
     return 0;
+  au = asn_user_by_ref_as_uword (s->user_ref_as_uword);
+  au->last_use = ++am->user_use_count;
+  return au;
 }
 
-typedef union {
-  uword * value_vector;
-  struct {
-    uword is_inline : 1;
-    uword inline_value : BITS (uword) - 1;
-  };
-  uword as_uword;
-} asn_user_hash_value_t;
-
-always_inline uword *
+/* Returns vector of user references (as uword) for users whose public encrypt key starts
+   with given 1 through 32 bytes. */
+uword *
 asn_users_matching_encrypt_key (asn_main_t * am, asn_rx_or_tx_t rt, u8 * encrypt_key, uword n_bytes,
-				uword * result_vector)
-{
-  uword * hash = 0;
-  uword * p;
-  switch (n_bytes)
-    {
-    case 7:
-      hash = am->user_ref_by_public_encrypt_key_first_7_bytes[rt];
-      break;
-
-    case 8:
-      hash = am->user_ref_by_public_encrypt_key_first_8_bytes[rt];
-      break;
-
-    default:
-      ASSERT (0);
-      break;
-    }
-
-  vec_reset_length (result_vector);
-  p = hash_get (hash, encrypt_key);
-  if (p)
-    {
-      asn_user_hash_value_t hv;
-      hv.as_uword = p[0];
-      if (hv.is_inline)
-	vec_add1 (result_vector, hv.inline_value);
-      else
-	vec_add (result_vector, hv.value_vector, vec_len (hv.value_vector));
-    }
-
-  return result_vector;
-}
+				uword * result_vector);
 
 asn_user_t *
 asn_new_user_with_type (asn_main_t * am,
@@ -787,11 +1036,41 @@ void asn_user_update_keys (asn_main_t * am,
                            asn_crypto_private_keys_t * with_private_keys,
                            u32 with_random_private_keys);
 
+/* Creates users of given type for public keys not already known; all key indices are
+   sized once and filled in one pass.  Returns vector of user references (as uword), one per key. */
+uword *
+asn_users_bulk_insert (asn_main_t * am,
+		       asn_rx_or_tx_t rt,
+		       u32 user_type_index,
+		       asn_crypto_public_keys_t * public_keys,
+		       uword * result_user_refs);
+
 asn_user_t *
 asn_update_peer_user (asn_main_t * am, asn_rx_or_tx_t rt, u32 user_type_index, u8 * encrypt_key, u8 * auth_key);
 
+/* Removes user from all key indices and frees it.  User may be learned again later. */
+void asn_user_del (asn_main_t * am, asn_user_t * au);
+
+/* Deletes least recently used users of given type until at most max_users remain.
+   Self owned users, users set in keep_user_bitmap and users referenced by pending
+   exec ack handlers (see keep_users) are never deleted.
+   Returns number of users deleted. */
+uword asn_users_evict (asn_main_t * am, u32 user_type_index, uword max_users, uword * keep_user_bitmap);
+
 void asn_user_type_free (asn_user_type_t * t);
 
+/* Transmit all queued PDUs for socket now, corked or not.  When a blob writer fails to
+   read contents socket is closed (and freed) and the read error is returned. */
+clib_error_t * asn_socket_tx (asn_main_t * am, asn_socket_t * as);
+clib_error_t * asn_socket_uncork (asn_main_t * am, asn_socket_t * as);
+
+/* Cork/uncork all sockets. */
+always_inline void
+asn_main_cork (asn_main_t * am)
+{ am->tx_cork_count++; }
+
+clib_error_t * asn_main_uncork (asn_main_t * am);
+
 clib_error_t * asn_socket_exec_with_ack_handler (asn_main_t * am, asn_socket_t * as, asn_exec_ack_handler_t * ack_handler, char * fmt, ...);
 clib_error_t * asn_socket_exec (asn_main_t * am, asn_socket_t * as, asn_exec_ack_handler_function_t * function, char * fmt, ...);
 
@@ -857,6 +1136,14 @@ clib_error_t *
 asn_save_blob_with_contents (asn_main_t * am, asn_socket_t * as, asn_user_t * au, u8 * contents, char * fmt, ...);
 clib_error_t *
 asn_save_serialized_blob (asn_main_t * am, asn_socket_t * as, asn_user_t * au, char * fmt, ...);
+
+#define ASN_BLOB_WRITER_DEFAULT_MAX_TX_BUFFER_BYTES (64 << 10)
+#define ASN_RX_PDU_DEFAULT_SPILL_BYTES (1 << 20)
+
+/* Save blob with contents streamed from writer.  Writer is freed when blob is sent.
+   Streams to given socket or to first established client socket when AS is zero. */
+clib_error_t *
+asn_save_blob_with_writer (asn_main_t * am, asn_socket_t * as, asn_user_t * au, asn_blob_writer_t * bw, char * fmt, ...);
 clib_error_t *
 asn_unserialize_blob_contents (asn_main_t * am, asn_pdu_blob_t * blob, u32 n_bytes_in_pdu, ...);
 
@@ -96,6 +96,90 @@ new_message_user_pair_for_rx (asn_app_main_t * am,
   return up->index;
 }
 
+static uword
+asn_app_shared_secret_cache_key_sum (hash_t * h, uword key)
+{ return asn_app_message_public_key_pair_sum (uword_to_pointer (key, asn_app_message_public_key_pair_t *)); }
+
+static uword
+asn_app_shared_secret_cache_key_is_equal (hash_t * h, uword key0, uword key1)
+{
+  return asn_app_message_public_key_pairs_are_equal (uword_to_pointer (key0, asn_app_message_public_key_pair_t *),
+						      uword_to_pointer (key1, asn_app_message_public_key_pair_t *));
+}
+
+u8 *
+asn_app_shared_secret_for_key_pair (asn_app_main_t * am,
+                                    asn_app_message_public_key_pair_t * kp,
+                                    u8 * dst_private_key)
+{
+  asn_app_shared_secret_cache_t * c = &am->rx_shared_secret_cache;
+  asn_app_shared_secret_cache_entry_t * e;
+  uword * p, i;
+
+  if (! c->entries)
+    {
+      if (c->max_entries == 0)
+        c->max_entries = ASN_APP_SHARED_SECRET_CACHE_DEFAULT_MAX_ENTRIES;
+      vec_resize (c->entries, c->max_entries);
+      c->entry_index_by_public_key_pair
+        = hash_create2 (/* elts */ c->max_entries,
+                        /* user */ 0,
+                        /* value_bytes */ sizeof (uword),
+                        asn_app_shared_secret_cache_key_sum,
+                        asn_app_shared_secret_cache_key_is_equal,
+                        /* format pair/arg */
+                        0, 0);
+    }
+
+  c->n_uses++;
+
+  p = hash_get_mem (c->entry_index_by_public_key_pair, kp);
+  if (p)
+    {
+      e = vec_elt_at_index (c->entries, p[0]);
+      e->last_use = c->n_uses;
+      c->n_hits++;
+      return e->shared_secret;
+    }
+
+  /* Miss: take an unused entry or else evict least recently used one.
+     Linear scan is cheap next to crypto_box_beforenm. */
+  e = c->entries;
+  for (i = 1; i < vec_len (c->entries) && e->last_use != 0; i++)
+    if (c->entries[i].last_use < e->last_use)
+      e = c->entries + i;
+
+  if (e->last_use != 0)
+    {
+      hash_unset_mem (c->entry_index_by_public_key_pair, &e->public_key_pair);
+      c->n_evictions++;
+    }
+
+  e->public_key_pair = kp[0];
+  crypto_box_beforenm (e->shared_secret, e->public_key_pair.src, dst_private_key);
+  e->last_use = c->n_uses;
+  hash_set_mem (c->entry_index_by_public_key_pair, &e->public_key_pair, e - c->entries);
+  c->n_misses++;
+
+  return e->shared_secret;
+}
+
+void
+asn_app_shared_secret_cache_free (asn_app_shared_secret_cache_t * c)
+{
+  /* Don't leave secrets behind in freed memory. */
+  vec_zero (c->entries);
+  vec_free (c->entries);
+  hash_free (c->entry_index_by_public_key_pair);
+}
+
+u8 * format_asn_app_shared_secret_cache (u8 * s, va_list * va)
+{
+  asn_app_shared_secret_cache_t * c = va_arg (*va, asn_app_shared_secret_cache_t *);
+  return format (s, "shared secrets: %Ld hits, %Ld misses, %Ld evictions, %d max entries",
+		 c->n_hits, c->n_misses, c->n_evictions, c->max_entries);
+}
+
 static void
 free_user_pair (asn_app_main_t * am, uword up_index)
 {
@@ -1031,12 +1115,135 @@ static void asn_app_attribute_main_free (asn_app_attribute_main_t * am)
 
 void asn_app_free_user_with_type (asn_app_main_t * am, asn_app_user_type_enum_t user_type, u32 user_index)
 {
-    asn_app_user_type_t * app_ut = &am->user_types[ASN_APP_USER_TYPE_event];
-    asn_user_type_t * ut = &app_ut->user_type;
-    asn_user_t * au = asn_user_by_index_and_type (user_index, ut->index);
-    ut->free_user (au);
-    asn_app_invalidate_all_attributes (&app_ut->attribute_main, user_index);
-    pool_put_index (ut->user_pool, user_index);
+  asn_user_type_t * ut = &am->user_types[user_type].user_type;
+  asn_user_del (&am->asn_main, asn_user_by_index_and_type (user_index, ut->index));
+}
+
+/* Attributes, place unique ids and message user pairs are indexed by user outside of user pool. */
+static void asn_app_will_delete_user (asn_main_t * am, asn_user_t * au)
+{
+  asn_app_main_t * app_main = CONTAINER_OF (am, asn_app_main_t, asn_main);
+  asn_app_user_type_t * app_ut = asn_app_user_type_for_user (au);
+  asn_app_gen_user_t * gu = CONTAINER_OF (au, asn_app_gen_user_t, asn_user);
+  u32 * up_index;
+
+  asn_app_invalidate_all_attributes (&app_ut->attribute_main, au->index);
+
+  /* Free pairs (and their ephemeral private keys) used to send to this user. */
+  vec_foreach (up_index, gu->user_messages.message_user_pair_indices_for_tx)
+    if (! pool_is_free_index (app_main->user_message_pair_pool, up_index[0]))
+      free_user_pair (app_main, up_index[0]);
+  vec_reset_length (gu->user_messages.message_user_pair_indices_for_tx);
+
+  if (app_ut == &app_main->user_types[ASN_APP_USER_TYPE_place])
+    {
+      asn_app_place_t * p = CONTAINER_OF (au, asn_app_place_t, gen_user.asn_user);
+      uword * q;
+      if (p->location.unique_id
+          && (q = hash_get_mem (app_main->place_index_by_unique_id, p->location.unique_id))
+          && q[0] == au->index)
+        hash_unset_mem (app_main->place_index_by_unique_id, p->location.unique_id);
+    }
+}
+
+static uword *
+asn_app_keep_users_in_hash (uword * keep, uword * user_hash)
+{
+  hash_pair_t * p;
+  hash_foreach_pair (p, user_hash, ({
+    keep = clib_bitmap_ori (keep, p->key);
+  }));
+  return keep;
+}
+
+/* Message headers refer to their authors by user index; authors are always users. */
+static uword *
+asn_app_keep_message_authors (asn_app_user_type_t * app_ut, uword * keep)
+{
+  asn_user_type_t * ut = &app_ut->user_type;
+  uword i, ti, mi;
+
+  vec_foreach_index (i, ut->user_pool)
+    {
+      asn_app_gen_user_t * gu;
+      asn_app_user_messages_t * msgs;
+
+      if (pool_is_free_index (ut->user_pool, i))
+        continue;
+      gu = CONTAINER_OF (asn_user_by_index_and_type (i, ut->index), asn_app_gen_user_t, asn_user);
+      msgs = &gu->user_messages;
+      vec_foreach_index (ti, msgs->message_pool_by_type)
+        {
+          void * msg_pool = msgs->message_pool_by_type[ti];
+          asn_app_message_type_t * mt;
+          if (! msg_pool)
+            continue;
+          mt = pool_elt (asn_app_message_type_pool, ti);
+          vec_foreach_index (mi, msg_pool)
+            {
+              asn_app_message_header_t * h;
+              if (pool_is_free_index (msg_pool, mi))
+                continue;
+              h = msg_pool + mt->user_msg_n_bytes * mi + mt->user_msg_offset_of_message_header;
+              keep = clib_bitmap_ori (keep, h->from_user_index);
+            }
+        }
+    }
+  return keep;
+}
+
+uword asn_app_evict_peer_users (asn_app_main_t * am)
+{
+  uword * keep[ASN_APP_N_USER_TYPE];
+  uword i, t, n_evicted = 0;
+
+  if (am->max_peer_users_per_type == 0)
+    return 0;
+
+  /* Keep users referenced by user index from friends, groups, events and messages of any remaining user.
+     Users referenced by pending exec ack handlers are kept by asn_users_evict. */
+  memset (keep, 0, sizeof (keep));
+  {
+    asn_app_user_t * us = am->user_types[ASN_APP_USER_TYPE_user].user_type.user_pool;
+    vec_foreach_index (i, us)
+      {
+        if (pool_is_free_index (us, i))
+          continue;
+        keep[ASN_APP_USER_TYPE_user] = asn_app_keep_users_in_hash (keep[ASN_APP_USER_TYPE_user], us[i].user_friends);
+        keep[ASN_APP_USER_TYPE_event] = asn_app_keep_users_in_hash (keep[ASN_APP_USER_TYPE_event], us[i].events_rsvpd_for_user);
+      }
+  }
+  {
+    asn_app_user_group_t * gs = am->user_types[ASN_APP_USER_TYPE_user_group].user_type.user_pool;
+    vec_foreach_index (i, gs)
+      {
+        if (pool_is_free_index (gs, i))
+          continue;
+        keep[ASN_APP_USER_TYPE_user] = asn_app_keep_users_in_hash (keep[ASN_APP_USER_TYPE_user], gs[i].group_users);
+      }
+  }
+  {
+    asn_app_event_t * es = am->user_types[ASN_APP_USER_TYPE_event].user_type.user_pool;
+    vec_foreach_index (i, es)
+      {
+        if (pool_is_free_index (es, i))
+          continue;
+        keep[ASN_APP_USER_TYPE_user] = asn_app_keep_users_in_hash (keep[ASN_APP_USER_TYPE_user], es[i].users_rsvpd_for_event);
+        keep[ASN_APP_USER_TYPE_user] = asn_app_keep_users_in_hash (keep[ASN_APP_USER_TYPE_user], es[i].users_invited_to_event);
+        keep[ASN_APP_USER_TYPE_user_group] = asn_app_keep_users_in_hash (keep[ASN_APP_USER_TYPE_user_group], es[i].groups_invited_to_event);
+      }
+  }
+  for (t = 0; t < ASN_APP_N_USER_TYPE; t++)
+    keep[ASN_APP_USER_TYPE_user] = asn_app_keep_message_authors (&am->user_types[t], keep[ASN_APP_USER_TYPE_user]);
+
+  for (t = 0; t < ASN_APP_N_USER_TYPE; t++)
+    {
+      n_evicted += asn_users_evict (&am->asn_main, am->user_types[t].user_type.index,
+                                    am->max_peer_users_per_type, keep[t]);
+      clib_bitmap_free (keep[t]);
+    }
+
+  return n_evicted;
 }
 
 void asn_app_user_type_free (asn_app_user_type_t * t)
@@ -1048,12 +1255,15 @@ void asn_app_user_type_free (asn_app_user_type_t * t)
 void asn_app_main_free (asn_app_main_t * am)
 {
   asn_app_user_type_t * ut;
+  if (am->asn_main.verbose)
+    clib_warning ("%U", format_asn_app_shared_secret_cache, &am->rx_shared_secret_cache);
   asn_main_free (&am->asn_main);
   for (ut = am->user_types; ut < am->user_types + ARRAY_LEN (am->user_types); ut++)
     asn_app_user_type_free (ut);
   pool_free (am->user_message_pair_pool);
   hash_free (am->place_index_by_unique_id);
   hash_free (am->user_message_pair_index_by_public_key_pair);
+  asn_app_shared_secret_cache_free (&am->rx_shared_secret_cache);
 }
 
 void asn_app_user_messages_free (asn_app_user_messages_t * m)
@@ -1967,6 +2177,27 @@ learn_users_exec_ack_handler_free (asn_exec_ack_handler_t * ah, u32 force_free)
     }
 }
 
+static uword *
+asn_app_keep_user_ref (asn_user_ref_t * r, u32 user_type_index, uword * keep)
+{ return r->type_index == user_type_index ? clib_bitmap_ori (keep, r->user_index) : keep; }
+
+/* Users already found by lookup are referenced by pointer until all unknown users are learned. */
+static uword *
+learn_users_exec_ack_handler_keep_users (asn_exec_ack_handler_t * ah, u32 user_type_index, uword * keep)
+{
+  learn_users_exec_ack_handler_t * lah = CONTAINER_OF (ah, learn_users_exec_ack_handler_t, ack_handler);
+  asn_app_users_lookup_t * lu = lah->users_lookup;
+  uword i;
+
+  vec_foreach_index (i, lu->users)
+    {
+      asn_user_t * au = lu->users[i].user;
+      if (au && au->user_type_index == user_type_index)
+        keep = clib_bitmap_ori (keep, au->index);
+    }
+  return keep;
+}
+
 static clib_error_t *
 learn_user_for_subscribers_exec_ack_handler (asn_exec_ack_handler_t * ah, asn_pdu_ack_t * ack, u32 n_bytes_ack_data)
 {
@@ -2057,6 +2288,7 @@ asn_app_subscribers_blob_handler (asn_blob_handler_t * bh, asn_pdu_blob_t * blob
                STRUCT_OFFSET_OF (learn_users_exec_ack_handler_t, ack_handler));
 
             ah->ack_handler.free = learn_users_exec_ack_handler_free;
+            ah->ack_handler.keep_users = learn_users_exec_ack_handler_keep_users;
             ah->users_lookup = lu;
             ah->user_index = i;
 
@@ -2137,6 +2369,16 @@ asn_app_create_user_and_blob_ack_handler (asn_exec_ack_handler_t * asn_ah, asn_p
   return asn_app_user_update_blob_helper (app_main, ah->create_user_type, ah->create_user_index, /* is_new_user */ 1);
 }
 
+static uword *
+asn_app_create_user_and_blob_ack_handler_keep_users (asn_exec_ack_handler_t * asn_ah, u32 user_type_index, uword * keep)
+{
+  asn_app_create_user_and_blob_ack_handler_t * ah = CONTAINER_OF (asn_ah, asn_app_create_user_and_blob_ack_handler_t, ack_handler);
+  asn_app_main_t * app_main = CONTAINER_OF (asn_ah->asn_main, asn_app_main_t, asn_main);
+  if (app_main->user_types[ah->create_user_type].user_type.index == user_type_index)
+    keep = clib_bitmap_ori (keep, ah->create_user_index);
+  return keep;
+}
+
 clib_error_t *
 asn_app_create_user_and_blob_with_type (asn_app_main_t * am, asn_app_user_type_enum_t user_type, u32 user_index)
 {
@@ -2148,6 +2390,7 @@ asn_app_create_user_and_blob_with_type (asn_app_main_t * am, asn_app_user_type_e
     (asn_app_create_user_and_blob_ack_handler,
      sizeof (ah[0]),
      STRUCT_OFFSET_OF (asn_app_create_user_and_blob_ack_handler_t, ack_handler));
+  ah->ack_handler.keep_users = asn_app_create_user_and_blob_ack_handler_keep_users;
   ah->create_user_type = user_type;
   ah->create_user_index = user_index;
 
@@ -2203,8 +2446,7 @@ asn_app_user_message_handler (asn_main_t * am, asn_socket_t * as,
   {
     asn_app_message_public_key_pair_t kp;
     asn_app_message_user_pair_t * up;
-    u8 * crypto_box_buffer;
-    u32 ephemeral_user_pair_index = ~0;
+    u8 * shared_secret = 0, * initial_nonce = 0;
     u8 nonce_for_this_message[crypto_box_nonce_bytes];
 
     memcpy (kp.src, crypto_header->src, sizeof (kp.src));
@@ -2212,21 +2454,24 @@ asn_app_user_message_handler (asn_main_t * am, asn_socket_t * as,
     up = asn_app_message_user_pair_by_public_key_pair (app_main, &kp);
     if (! up)
       up = asn_app_message_user_pair_by_public_key_pair (app_main, &kp);
-    if (! up)
+    if (up)
+      {
+        shared_secret = up->shared_secret;
+        initial_nonce = up->initial_nonce;
+      }
+    else
       {
 	asn_user_t * dst_au = asn_user_with_encrypt_key (am, ASN_TX, kp.dst);
 	if (dst_au && dst_au->private_key_is_valid)
 	  {
-            ephemeral_user_pair_index
-              = new_message_user_pair_for_rx (app_main,
-                                              &kp,
-                                              dst_au->crypto_keys.private.encrypt_key,
-                                              am->server_nonce);
-	    up = pool_elt_at_index (app_main->user_message_pair_pool, ephemeral_user_pair_index);
+            /* Message to our permanent key: shared secret comes from cache. */
+            shared_secret = asn_app_shared_secret_for_key_pair (app_main, &kp,
+                                                                dst_au->crypto_keys.private.encrypt_key);
+            initial_nonce = am->server_nonce;
 	  }
       }
 
-    if (! up)
+    if (! shared_secret)
       {
 	error = clib_error_return (0, "no such key pair %U -> %U",
 				   format_hex_bytes, kp.src, sizeof (kp.src),
@@ -2234,27 +2479,23 @@ asn_app_user_message_handler (asn_main_t * am, asn_socket_t * as,
 	goto done;
       }
 
-    crypto_box_buffer = crypto_header->authentication - crypto_box_reserved_pad_authentication_offset;
-    memcpy (nonce_for_this_message, up->initial_nonce, sizeof (nonce_for_this_message));
+    memcpy (nonce_for_this_message, initial_nonce, sizeof (nonce_for_this_message));
     asn_crypto_add_to_nonce (nonce_for_this_message, crypto_header->sequence_number, sizeof (crypto_header->sequence_number));
 
     if (am->verbose)
       clib_warning ("receiving %U -> %U sequence %U nonce %U",
-                    format_hex_bytes, up->public_key_pair.src, 8,
-                    format_asn_user_with_key, am, up->public_key_pair.dst,
+                    format_hex_bytes, kp.src, 8,
+                    format_asn_user_with_key, am, kp.dst,
                     format_hex_bytes, crypto_header->sequence_number, sizeof (crypto_header->sequence_number),
                     format_hex_bytes, nonce_for_this_message, sizeof (nonce_for_this_message));
 
-    memset (crypto_box_buffer, 0, crypto_box_reserved_pad_authentication_offset);
-    if (crypto_box_open_afternm (crypto_box_buffer, crypto_box_buffer, crypto_box_reserved_pad_bytes + n_bytes_message_contents,
-				 nonce_for_this_message, up->shared_secret) < 0)
+    if (crypto_box_open_detached_afternm (crypto_header->message_contents, crypto_header->message_contents,
+					  crypto_header->authentication, n_bytes_message_contents,
+					  nonce_for_this_message, shared_secret) < 0)
       {
 	error = clib_error_return (0, "message authentication fails");
 	goto done;
       }
-
-    if (ephemeral_user_pair_index != ~0)
-      free_user_pair (app_main, ephemeral_user_pair_index);
   }
 
   owner_au = asn_user_with_encrypt_key (am, ASN_TX, blob->owner);
@@ -2428,6 +2669,7 @@ asn_app_message_blob_handler (asn_blob_handler_t * bh,
           lah->users_lookup = lu;
           lah->user_index = i;
           lah->ack_handler.free = learn_users_for_received_message_exec_ack_handler_free;
+          lah->ack_handler.keep_users = learn_users_exec_ack_handler_keep_users;
           ah->blob_pdu = blob_pdu;
           ah->n_bytes_in_blob_pdu = n_bytes_in_pdu;
 
@@ -2457,6 +2699,10 @@ typedef struct {
   asn_user_ref_t to_user_ref;
 } asn_app_self_sent_message_blob_ack_handler_t;
 
+static uword *
+asn_app_send_message_blob_ack_handler_keep_users (asn_exec_ack_handler_t * ah, u32 user_type_index, uword * keep)
+{ return asn_app_keep_user_ref (&CONTAINER_OF (ah, asn_app_self_sent_message_blob_ack_handler_t, ack_handler)->to_user_ref, user_type_index, keep); }
+
 static clib_error_t *
 asn_app_send_message_blob_ack_handler (asn_exec_ack_handler_t * asn_ah, asn_pdu_ack_t * ack, u32 n_bytes_ack_data)
 {
@@ -2594,7 +2840,6 @@ asn_app_send_message_to_user (asn_app_main_t * app_main,
     asn_app_gen_user_t * to_gen_user = CONTAINER_OF (to_asn_user, asn_app_gen_user_t, asn_user);
     asn_app_message_user_pair_t * up;
     uword n_user_data_bytes;
-    u8 * crypto_box_buffer;
     u8 nonce_for_this_message[crypto_box_nonce_bytes];
 
     if (vec_len (to_gen_user->user_messages.message_user_pair_indices_for_tx) == 0)
@@ -2635,8 +2880,6 @@ asn_app_send_message_to_user (asn_app_main_t * app_main,
     n_user_data_bytes = vec_len (contents) - sizeof (ch[0]);
 
     ch = (void *) contents;
-    crypto_box_buffer = ch->authentication - crypto_box_reserved_pad_authentication_offset;
-    memset (crypto_box_buffer, 0, crypto_box_reserved_pad_authentication_offset + sizeof (ch->authentication));
     memcpy (nonce_for_this_message, up->initial_nonce, sizeof (nonce_for_this_message));
     asn_crypto_add_to_nonce (nonce_for_this_message, up->sequence_number, sizeof (up->sequence_number));
 
@@ -2647,8 +2890,9 @@ asn_app_send_message_to_user (asn_app_main_t * app_main,
                     format_hex_bytes, up->sequence_number, sizeof (up->sequence_number),
                     format_hex_bytes, nonce_for_this_message, sizeof (nonce_for_this_message));
 
-    crypto_box_afternm (crypto_box_buffer, crypto_box_buffer, crypto_box_reserved_pad_bytes + n_user_data_bytes,
-			nonce_for_this_message, up->shared_secret);
+    crypto_box_detached_afternm (ch->message_contents, ch->authentication,
+				 ch->message_contents, n_user_data_bytes,
+				 nonce_for_this_message, up->shared_secret);
 
     memcpy (ch->src, up->public_key_pair.src, sizeof (ch->src));
     memcpy (ch->sequence_number, up->sequence_number, sizeof (up->sequence_number));
@@ -2661,6 +2905,7 @@ asn_app_send_message_to_user (asn_app_main_t * app_main,
      sizeof (ah[0]),
      STRUCT_OFFSET_OF (asn_app_self_sent_message_blob_ack_handler_t, ack_handler));
 
+  ah->ack_handler.keep_users = asn_app_send_message_blob_ack_handler_keep_users;
   ah->to_user_ref.type_index = to_asn_user->user_type_index;
   ah->to_user_ref.user_index = to_asn_user->index;
   ah->msg_ref = msg_header->ref;
@@ -2768,6 +3013,10 @@ typedef struct {
   asn_app_message_ref_t invitation_msg_ref;
 } learn_user_for_invitation_exec_ack_handler_t;
 
+static uword *
+learn_user_for_invitation_exec_ack_handler_keep_users (asn_exec_ack_handler_t * ah, u32 user_type_index, uword * keep)
+{ return asn_app_keep_user_ref (&CONTAINER_OF (ah, learn_user_for_invitation_exec_ack_handler_t, ack_handler)->src_user_ref, user_type_index, keep); }
+
 static clib_error_t *
 learn_user_for_invitation_exec_ack_handler (asn_exec_ack_handler_t * ah, asn_pdu_ack_t * ack, u32 n_bytes_ack_data)
 {
@@ -2818,6 +3067,7 @@ asn_app_invitation_maybe_learn_new_user (asn_main_t * am, asn_socket_t * as, asn
          sizeof (learn_user_for_invitation_exec_ack_handler_t),
          STRUCT_OFFSET_OF (learn_user_for_invitation_exec_ack_handler_t, ack_handler));
 
+      ah->ack_handler.keep_users = learn_user_for_invitation_exec_ack_handler_keep_users;
       ah->src_user_ref.user_index = src_au->index;
       ah->src_user_ref.type_index = src_au->user_type_index;
       ah->invitation_msg_ref = h->ref;
@@ -3186,7 +3436,7 @@ learn_existing_place_exec_ack_handler (asn_exec_ack_handler_t * ah, asn_pdu_ack_
   if (error)
     {
       if (place_au)
-        asn_user_del (place_au);
+        asn_user_del (am, place_au);
     }
   return error;
 }
@@ -3233,6 +3483,9 @@ static clib_error_t * do_check_in (asn_app_main_t * am, asn_app_user_t * user, a
   vec_sort (place->recent_check_ins_at_place, (void *) sort_check_in_most_recent_last);
   ASSERT (asn_app_user_check_in_at_place_vector_is_sorted (place->recent_check_ins_at_place));
 
+  /* Send both check-in blobs together. */
+  asn_main_cork (&am->asn_main);
+
   error = asn_save_serialized_blob (&am->asn_main, /* all client sockets */ 0,
                                     &place->gen_user.asn_user,
                                     "checkins/%U_%Lx", format_hex_bytes, ci->user_key.data, 8, ci->time_stamp_in_nsec_from_1970,
@@ -3267,6 +3520,13 @@ static clib_error_t * do_check_in (asn_app_main_t * am, asn_app_user_t * user, a
   }
 
  done:
+  {
+    clib_error_t * tx_error = asn_main_uncork (&am->asn_main);
+    if (! error)
+      error = tx_error;
+    else if (tx_error)
+      clib_error_report (tx_error);
+  }
   return error;
 }
 
@@ -3416,6 +3676,10 @@ typedef struct {
   u64 blob_time_stamp;
 } learn_user_for_check_in_exec_ack_handler_t;
 
+static uword *
+learn_user_for_check_in_exec_ack_handler_keep_users (asn_exec_ack_handler_t * ah, u32 user_type_index, uword * keep)
+{ return asn_app_keep_user_ref (&CONTAINER_OF (ah, learn_user_for_check_in_exec_ack_handler_t, ack_handler)->owner_user_ref, user_type_index, keep); }
+
 static clib_error_t *
 learn_user_for_check_in_exec_ack_handler (asn_exec_ack_handler_t * ah, asn_pdu_ack_t * ack, u32 n_bytes_ack_data)
 {
@@ -3496,6 +3760,7 @@ asn_app_check_in_blob_handler (asn_blob_handler_t * bh, asn_pdu_blob_t * blob, u
          STRUCT_OFFSET_OF (learn_user_for_check_in_exec_ack_handler_t, ack_handler));
 
       ah->check_in_to_add = ci_add;
+      ah->ack_handler.keep_users = learn_user_for_check_in_exec_ack_handler_keep_users;
       ah->owner_user_ref.user_index = owner_au->index;
       ah->owner_user_ref.type_index = owner_au->user_type_index;
       ah->blob_time_stamp = blob_time_stamp;
@@ -3580,7 +3845,7 @@ asn_app_message_public_key_pair_hash_key_sum (hash_t * h, uword hk0)
 {
   asn_app_main_t * am = uword_to_pointer (h->user, asn_app_main_t *);
   asn_app_message_public_key_pair_t * k0 = asn_app_message_public_key_pair_for_hash_key (am, hk0);
-  return hash_memory (k0, sizeof (k0[0]), /* hash_seed */ 0);
+  return asn_app_message_public_key_pair_sum (k0);
 }
 
 static uword
@@ -3589,7 +3854,7 @@ asn_app_message_public_key_pair_hash_key_is_equal (hash_t * h, uword hk0, uword
   asn_app_main_t * am = uword_to_pointer (h->user, asn_app_main_t *);
   asn_app_message_public_key_pair_t * k0 = asn_app_message_public_key_pair_for_hash_key (am, hk0);
   asn_app_message_public_key_pair_t * k1 = asn_app_message_public_key_pair_for_hash_key (am, hk1);
-  return memcmp (k0, k1, sizeof (k0[0])) == 0;
+  return asn_app_message_public_key_pairs_are_equal (k0, k1);
 }
 
 static void asn_app_message_main_init (asn_app_main_t * am)
@@ -3620,6 +3885,7 @@ void asn_app_main_init (asn_app_main_t * am)
           .user_type_n_bytes = sizeof (asn_app_user_t),
           .user_type_offset_of_asn_user = STRUCT_OFFSET_OF (asn_app_user_t, gen_user.asn_user),
           .free_user = asn_app_free_user,
+          .will_delete_user = asn_app_will_delete_user,
           .serialize_pool_users = serialize_pool_asn_app_user,
           .unserialize_pool_users = unserialize_pool_asn_app_user,
         },
@@ -3640,6 +3906,7 @@ void asn_app_main_init (asn_app_main_t * am)
           .user_type_n_bytes = sizeof (asn_app_user_group_t),
           .user_type_offset_of_asn_user = STRUCT_OFFSET_OF (asn_app_user_group_t, gen_user.asn_user),
           .free_user = asn_app_free_user_group,
+          .will_delete_user = asn_app_will_delete_user,
           .serialize_pool_users = serialize_pool_asn_app_user_group,
           .unserialize_pool_users = unserialize_pool_asn_app_user_group,
         },
@@ -3660,6 +3927,7 @@ void asn_app_main_init (asn_app_main_t * am)
           .user_type_n_bytes = sizeof (asn_app_event_t),
           .user_type_offset_of_asn_user = STRUCT_OFFSET_OF (asn_app_event_t, gen_user.asn_user),
           .free_user = asn_app_free_event,
+          .will_delete_user = asn_app_will_delete_user,
           .serialize_pool_users = serialize_pool_asn_app_event,
           .unserialize_pool_users = unserialize_pool_asn_app_event,
         },
@@ -3680,6 +3948,7 @@ void asn_app_main_init (asn_app_main_t * am)
           .user_type_n_bytes = sizeof (asn_app_place_t),
           .user_type_offset_of_asn_user = STRUCT_OFFSET_OF (asn_app_place_t, gen_user.asn_user),
           .free_user = asn_app_free_place,
+          .will_delete_user = asn_app_will_delete_user,
           .serialize_pool_users = serialize_pool_asn_app_place,
           .unserialize_pool_users = unserialize_pool_asn_app_place,
         },
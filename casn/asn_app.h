@@ -175,6 +175,15 @@ typedef struct {
   u8 dst[crypto_box_public_key_bytes];
 } asn_app_message_public_key_pair_t;
 
+/* Asymmetric so that (a, b) and (b, a) (both directions of a conversation) hash differently. */
+always_inline uword
+asn_app_message_public_key_pair_sum (asn_app_message_public_key_pair_t * kp)
+{ return asn_user_key_fingerprint (kp->src) ^ (asn_user_key_fingerprint (kp->dst) * 0x9e3779b97f4a7c15ULL); }
+
+always_inline uword
+asn_app_message_public_key_pairs_are_equal (asn_app_message_public_key_pair_t * kp0, asn_app_message_public_key_pair_t * kp1)
+{ return asn_user_keys_are_equal (kp0->src, kp1->src) && asn_user_keys_are_equal (kp0->dst, kp1->dst); }
+
 typedef struct {
   asn_app_message_public_key_pair_t public_key_pair;
 
@@ -191,6 +200,32 @@ typedef struct {
   u32 index;
 } asn_app_message_user_pair_t;
 
+/* Shared secrets derived for messages sent to our permanent keys.
+   Keeps repeat senders from paying for crypto_box_beforenm on every message. */
+typedef struct {
+  asn_app_message_public_key_pair_t public_key_pair;
+
+  u8 shared_secret[crypto_box_shared_secret_bytes];
+
+  /* Cache use count when entry was last used; zero for unused entry. */
+  u64 last_use;
+} asn_app_shared_secret_cache_entry_t;
+
+typedef struct {
+  /* Allocated once with max entries since hash keys point into entries. */
+  asn_app_shared_secret_cache_entry_t * entries;
+
+  uword * entry_index_by_public_key_pair;
+
+  u64 n_uses;
+
+  u32 max_entries;
+
+  u64 n_hits, n_misses, n_evictions;
+} asn_app_shared_secret_cache_t;
+
+#define ASN_APP_SHARED_SECRET_CACHE_DEFAULT_MAX_ENTRIES 256
+
 #define foreach_asn_app_attribute_type		\
   _ (u8) _ (u16) _ (u32) _ (u64) _ (f64)	\
   _ (bitmap)					\
@@ -423,8 +458,18 @@ typedef struct asn_app_main_t {
 
   /* Hash mapping crypto header to message user key pair. */
   uword * user_message_pair_index_by_public_key_pair;
+
+  asn_app_shared_secret_cache_t rx_shared_secret_cache;
+
+  /* When non-zero asn_app_evict_peer_users keeps at most this many users of each type. */
+  u32 max_peer_users_per_type;
 } asn_app_main_t;
 
+/* Shared secret for key pair's source public key and our private key, from rx_shared_secret_cache. */
+u8 * asn_app_shared_secret_for_key_pair (asn_app_main_t * am, asn_app_message_public_key_pair_t * kp, u8 * dst_private_key);
+void asn_app_shared_secret_cache_free (asn_app_shared_secret_cache_t * c);
+format_function_t format_asn_app_shared_secret_cache;
+
 always_inline asn_app_user_t *
 asn_app_user_with_index (asn_app_main_t * am, u32 index)
 {
@@ -529,6 +574,10 @@ void asn_app_main_init (asn_app_main_t * am);
 void asn_app_main_free (asn_app_main_t * am);
 
 void asn_app_free_user_with_type (asn_app_main_t * am, asn_app_user_type_enum_t user_type, u32 user_index);
+
+/* Deletes least recently used peer users not referenced by friends, groups or events.
+   Call periodically; returns number of users deleted. */
+uword asn_app_evict_peer_users (asn_app_main_t * am);
 clib_error_t * asn_app_create_user_and_blob_with_type (asn_app_main_t * am, asn_app_user_type_enum_t user_type, u32 user_index);
 
 clib_error_t * asn_app_main_write_to_file (asn_app_main_t * am, char * unix_file);
@@ -23,6 +23,69 @@ int crypto_box_open_afternm (u8 * clear_text,
                              const u8 * nonce,
                              const u8 * secret_key);
 
+/* No reserved bytes: authentication (16 bytes) is separate from cipher text.
+   Clear text may be the same buffer as cipher text.  Encryption and authentication
+   are done in a single pass over the data. */
+int crypto_box_detached_afternm (u8 * cipher_text,
+                                 u8 * authentication,
+                                 const u8 * clear_text,
+                                 u64 n_bytes,
+                                 const u8 * nonce,
+                                 const u8 * secret_key);
+
+/* On authentication failure clear text is zeroed. */
+int crypto_box_open_detached_afternm (u8 * clear_text,
+                                      const u8 * cipher_text,
+                                      const u8 * authentication,
+                                      u64 n_bytes,
+                                      const u8 * nonce,
+                                      const u8 * secret_key);
+
+/* Salsa20 keystream implementations.  Default picks fastest one cpu supports;
+   others may be selected for testing.  Returns -1 when cpu does not support implementation. */
+typedef enum {
+  CRYPTO_STREAM_SALSA20_IMPLEMENTATION_default,
+  CRYPTO_STREAM_SALSA20_IMPLEMENTATION_reference,
+  CRYPTO_STREAM_SALSA20_IMPLEMENTATION_sse2,
+  CRYPTO_STREAM_SALSA20_IMPLEMENTATION_avx2,
+} crypto_stream_salsa20_implementation_t;
+
+int crypto_stream_salsa20_select_implementation (crypto_stream_salsa20_implementation_t i);
+int crypto_stream_salsa20_xor (u8 * c, const u8 * m, u64 n_bytes, const u8 * nonce, const u8 * key);
+int crypto_stream (u8 * c, u64 n_bytes, const u8 * nonce, const u8 * key);
+int crypto_stream_xor (u8 * c, const u8 * m, u64 n_bytes, const u8 * nonce, const u8 * key);
+
+/* Poly1305 implementations (as above for salsa20). */
+typedef enum {
+  CRYPTO_ONETIMEAUTH_IMPLEMENTATION_default,
+  CRYPTO_ONETIMEAUTH_IMPLEMENTATION_reference,
+  CRYPTO_ONETIMEAUTH_IMPLEMENTATION_donna64,
+} crypto_onetimeauth_implementation_t;
+
+int crypto_onetimeauth_select_implementation (crypto_onetimeauth_implementation_t i);
+int crypto_onetimeauth (u8 * authentication, const u8 * m, u64 n_bytes, const u8 * key);
+int crypto_onetimeauth_verify (const u8 * authentication, const u8 * m, u64 n_bytes, const u8 * key);
+
+/* Curve25519 scalar multiplication implementations (as above for salsa20). */
+typedef enum {
+  CRYPTO_SCALARMULT_IMPLEMENTATION_default,
+  CRYPTO_SCALARMULT_IMPLEMENTATION_reference,
+  CRYPTO_SCALARMULT_IMPLEMENTATION_fe51,
+} crypto_scalarmult_implementation_t;
+
+int crypto_scalarmult_select_implementation (crypto_scalarmult_implementation_t i);
+int crypto_scalarmult (u8 * q, const u8 * n, const u8 * p);
+
+/* SHA-512 implementations (as above for salsa20): uclib sha512 is reference and default. */
+typedef enum {
+  CRYPTO_HASH_IMPLEMENTATION_default,
+  CRYPTO_HASH_IMPLEMENTATION_reference,
+  CRYPTO_HASH_IMPLEMENTATION_unrolled,
+} crypto_hash_implementation_t;
+
+int crypto_hash_select_implementation (crypto_hash_implementation_t i);
+int crypto_hash (u8 * out, const u8 * m, u64 n_bytes);
+
 #define crypto_box_public_key_bytes 32
 #define crypto_box_private_key_bytes 32
 #define crypto_box_authentication_bytes 16 /* poly1305 output */
@@ -33,6 +96,15 @@ int crypto_box_open_afternm (u8 * clear_text,
 #define crypto_sign_private_key_bytes 64
 #define crypto_sign_signature_bytes 64
 
+/* Fixed base scalar multiplication for key pairs and signing (as above for salsa20). */
+typedef enum {
+  CRYPTO_SIGN_IMPLEMENTATION_default,
+  CRYPTO_SIGN_IMPLEMENTATION_reference,
+  CRYPTO_SIGN_IMPLEMENTATION_table,
+} crypto_sign_implementation_t;
+
+int crypto_sign_select_implementation (crypto_sign_implementation_t i);
+
 int crypto_sign_keypair (u8 * public, u8 * private, int want_random);
 
 int crypto_sign (u8 * signed_message, u64 * n_signed_message_bytes,
@@ -43,4 +115,20 @@ int crypto_sign_open (u8 * message, u64 * n_message_bytes,
                       u64 n_signed_message_bytes,
                       const u8 * public_key);
 
+/* Verify N signed messages (messages are not copied out).  Signatures are checked in batches
+   with one multi-scalar multiplication; when a batch fails each signature in it is checked
+   separately with crypto_sign_open.  Sets VALID[i] to 1 for good signatures; returns 0 when
+   all are good, -1 otherwise.
+
+   Batch check is cofactored (verification equation is multiplied by 8) whereas crypto_sign_open
+   is cofactorless: a signature whose R or public key has a small order component may pass in a
+   good batch yet fail crypto_sign_open (and so fail when its batch holds a bad signature).
+   Only holder of private key can make such signatures; callers which need results to match
+   crypto_sign_open exactly must call it instead. */
+int crypto_sign_verify_batch (int * valid,
+                              const u8 ** signed_messages,
+                              const u64 * n_signed_message_bytes,
+                              const u8 ** public_keys,
+                              u64 n_signed_messages);
+
 #endif /* included_casn_tweetnacl_h */
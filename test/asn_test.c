@@ -0,0 +1,1298 @@
+#include <uclib/uclib.h>
+#include <casn/asn.h>
+#include <casn/asn_app.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+
+/* Unit tests of ASN data structures which need no network. */
+
+typedef struct {
+  u32 seed;
+  u32 n_iterations;
+  u32 verbose;
+
+  /* Plain asn_user_t users for key index tests. */
+  asn_user_type_t user_type;
+} test_asn_main_t;
+
+static u32 test_random (test_asn_main_t * tm)
+{
+  tm->seed = 1664525 * tm->seed + 1013904223;
+  return tm->seed >> 8;
+}
+
+static void test_random_bytes (test_asn_main_t * tm, u8 * b, uword n_bytes)
+{
+  uword i;
+  for (i = 0; i < n_bytes; i++)
+    b[i] = test_random (tm);
+}
+
+static void test_random_public_keys (test_asn_main_t * tm, asn_crypto_public_keys_t * pk)
+{
+  memset (pk, 0, sizeof (pk[0]));
+  test_random_bytes (tm, pk->encrypt_key, sizeof (pk->encrypt_key));
+}
+
+static uword test_user_ref_as_uword (asn_user_t * au)
+{
+  asn_user_ref_t r;
+  r.type_index = au->user_type_index;
+  r.user_index = au->index;
+  return asn_user_ref_as_uword (&r);
+}
+
+/* True when prefix query for first N_BYTES of KEY returns exactly REF (or nothing for ~0). */
+static uword test_prefix_query_is (asn_main_t * am, u8 * key, uword n_bytes, uword ref)
+{
+  uword * rv = asn_users_matching_encrypt_key (am, ASN_TX, key, n_bytes, 0);
+  uword ok = ref == ~0 ? vec_len (rv) == 0 : vec_len (rv) == 1 && rv[0] == ref;
+  vec_free (rv);
+  return ok;
+}
+
+/* Delete all test users and free key indices. */
+static void test_users_free (test_asn_main_t * tm, asn_main_t * am)
+{
+  asn_user_type_t * ut = &tm->user_type;
+  uword i;
+
+  vec_foreach_index (i, ut->user_pool)
+    if (! pool_is_free_index (ut->user_pool, i))
+      asn_user_del (am, asn_user_by_index_and_type (i, ut->index));
+  pool_free (ut->user_pool);
+
+  for (i = 0; i < ASN_N_RX_TX; i++)
+    {
+      asn_user_key_table_free (&am->user_ref_by_public_encrypt_key[i]);
+      asn_user_key_prefix_index_free (&am->user_ref_by_public_encrypt_key_prefix[i]);
+    }
+}
+
+/* Random insert/delete/lookup against reference set.  Table is kept at 16 slots with most home
+   slots crafted to be near end so probe runs wrap around; some keys share fingerprints. */
+static clib_error_t * test_user_key_table (test_asn_main_t * tm)
+{
+  clib_error_t * error = 0;
+  asn_main_t _am, * am = &_am;
+  asn_user_type_t * ut = &tm->user_type;
+  asn_user_key_table_t _t, * t = &_t;
+  asn_user_key_table_slot_t * s;
+  asn_user_t ** users = 0, * au;
+  u32 * user_indices = 0;
+  uword * is_member = 0;
+  uword round, iter, i, c, n_members, n_users = 24, max_members = 8;
+
+  memset (am, 0, sizeof (am[0]));
+
+  for (round = 0; round < 16; round++)
+    {
+      u64 inv, f;
+
+      memset (t, 0, sizeof (t[0]));
+      asn_user_key_table_resize (t, max_members);
+      if (t->log2_n_slots != 4)
+	{
+	  error = clib_error_return (0, "key table: %d slots for %d elts, expected 16",
+				     1 << t->log2_n_slots, max_members);
+	  goto done;
+	}
+
+      /* Inverse of odd multiplier mod 2^64 to pick fingerprints with given home slot. */
+      inv = t->hash_multiplier;
+      for (i = 0; i < 5; i++)
+	inv *= 2 - t->hash_multiplier * inv;
+
+      /* Allocate all users first: pointers stay valid once pool stops growing. */
+      vec_reset_length (user_indices);
+      for (c = 0; c < n_users; c++)
+	vec_add1 (user_indices, asn_user_alloc_with_type (ut)->index);
+      vec_reset_length (users);
+      for (c = 0; c < n_users; c++)
+	{
+	  au = asn_user_by_index_and_type (user_indices[c], ut->index);
+	  vec_add1 (users, au);
+	  test_random_bytes (tm, au->crypto_keys.public.encrypt_key, sizeof (au->crypto_keys.public.encrypt_key));
+	  if (c % 4 == 3)
+	    /* Same fingerprint as previous key; rest of key differs. */
+	    f = asn_user_key_fingerprint (users[c - 1]->crypto_keys.public.encrypt_key);
+	  else
+	    {
+	      /* Home slot 13, 14 or 15 for most keys; anywhere for the rest. */
+	      f = ((u64) test_random (tm) << 40) ^ test_random (tm);
+	      if (c % 4 != 2)
+		f = (((u64) (13 + c % 3) << 60) | (f & pow2_mask (60))) * inv;
+	    }
+	  memcpy (au->crypto_keys.public.encrypt_key, &f, sizeof (f));
+	}
+      clib_bitmap_zero (is_member);
+      n_members = 0;
+
+      for (iter = 0; iter < tm->n_iterations; iter++)
+	{
+	  c = test_random (tm) % n_users;
+	  au = users[c];
+
+	  if (clib_bitmap_get (is_member, c))
+	    {
+	      s = asn_user_key_table_get (t, au->crypto_keys.public.encrypt_key);
+	      if (! s)
+		{
+		  error = clib_error_return (0, "key table: round %d iteration %d, user %d not found for delete",
+					     round, iter, c);
+		  goto done;
+		}
+	      asn_user_key_table_unset (t, s);
+	      is_member = clib_bitmap_set (is_member, c, 0);
+	      n_members--;
+	    }
+	  else if (n_members < max_members)
+	    {
+	      asn_user_key_table_set (t, au);
+	      is_member = clib_bitmap_set (is_member, c, 1);
+	      n_members++;
+	    }
+
+	  if (t->n_elts != n_members || vec_len (t->slots) != 16)
+	    {
+	      error = clib_error_return (0, "key table: %d elts in %d slots, expected %d in 16",
+					 t->n_elts, vec_len (t->slots), n_members);
+	      goto done;
+	    }
+
+	  for (i = 0; i < n_users; i++)
+	    {
+	      s = asn_user_key_table_get (t, users[i]->crypto_keys.public.encrypt_key);
+	      if ((s != 0) != clib_bitmap_get (is_member, i)
+		  || (s && s->user_ref_as_uword != test_user_ref_as_uword (users[i])))
+		{
+		  error = clib_error_return (0, "key table: round %d iteration %d, user %d %s",
+					     round, iter, i, s ? "found" : "not found");
+		  goto done;
+		}
+	    }
+	}
+
+      /* Grow table past initial size: all users must still be found. */
+      for (i = 0; i < n_users; i++)
+	asn_user_key_table_set (t, users[i]);
+      for (i = 0; i < n_users; i++)
+	{
+	  s = asn_user_key_table_get (t, users[i]->crypto_keys.public.encrypt_key);
+	  if (! s || s->user_ref_as_uword != test_user_ref_as_uword (users[i]))
+	    {
+	      error = clib_error_return (0, "key table: round %d, user %d not found after resize", round, i);
+	      goto done;
+	    }
+	}
+      if (t->n_elts != n_users)
+	{
+	  error = clib_error_return (0, "key table: %d elts after resize, expected %d", t->n_elts, n_users);
+	  goto done;
+	}
+
+      asn_user_key_table_free (t);
+      test_users_free (tm, am);
+    }
+
+  if (tm->verbose)
+    clib_warning ("key table: ok");
+
+ done:
+  asn_user_key_table_free (t);
+  test_users_free (tm, am);
+  vec_free (users);
+  vec_free (user_indices);
+  clib_bitmap_free (is_member);
+  return error;
+}
+
+static int test_uword_compare (uword * a, uword * b)
+{ return a[0] < b[0] ? -1 : a[0] > b[0]; }
+
+/* Random single and multiple adds and deletes against reference set checked with prefix
+   queries of 1, 7, 8, 9 and 32 bytes answered from both recent vector and runs.
+   Keys copy one of a few base keys up to various lengths so every query length matters. */
+static clib_error_t * test_user_key_prefix_index (test_asn_main_t * tm)
+{
+  clib_error_t * error = 0;
+  asn_main_t _am, * am = &_am;
+  asn_user_type_t * ut = &tm->user_type;
+  asn_user_key_prefix_index_t * x = &am->user_ref_by_public_encrypt_key_prefix[ASN_TX];
+  asn_user_key_prefix_index_elt_t * elts = 0, * e;
+  static u32 query_lengths[] = { 1, 7, 8, 9, 32, };
+  static u32 shared_lengths[] = { 0, 1, 6, 7, 8, 9, 31, };
+  u8 bases[4][32], ** keys = 0;
+  u32 * user_indices = 0;
+  uword * refs = 0, * is_member = 0, * rv = 0, * expect = 0;
+  uword iter, op, i, j, k, c = 0, n, n_users = 4096, n_checks_with_runs = 0, max_runs = 0;
+
+  memset (am, 0, sizeof (am[0]));
+
+  for (i = 0; i < ARRAY_LEN (bases); i++)
+    test_random_bytes (tm, bases[i], sizeof (bases[i]));
+
+  for (c = 0; c < n_users; c++)
+    vec_add1 (user_indices, asn_user_alloc_with_type (ut)->index);
+  for (c = 0; c < n_users; c++)
+    {
+      asn_user_t * au = asn_user_by_index_and_type (user_indices[c], ut->index);
+      u8 * key = au->crypto_keys.public.encrypt_key;
+      test_random_bytes (tm, key, sizeof (au->crypto_keys.public.encrypt_key));
+      memcpy (key, bases[test_random (tm) % ARRAY_LEN (bases)],
+	      shared_lengths[test_random (tm) % ARRAY_LEN (shared_lengths)]);
+      vec_add1 (keys, key);
+      vec_add1 (refs, test_user_ref_as_uword (au));
+    }
+
+  /* Enough single adds for recent vector to become runs which are then merged. */
+  for (c = 0; c < 2 * ASN_USER_KEY_PREFIX_INDEX_MAX_RECENT; c++)
+    {
+      asn_user_key_prefix_index_add (x, keys[c], refs[c]);
+      is_member = clib_bitmap_set (is_member, c, 1);
+    }
+  if (vec_len (x->runs) != 1 || x->n_run_elts != 2 * ASN_USER_KEY_PREFIX_INDEX_MAX_RECENT)
+    {
+      error = clib_error_return (0, "prefix index: %d runs with %d elts after single adds, expected 1 with %d",
+				 vec_len (x->runs), x->n_run_elts, 2 * ASN_USER_KEY_PREFIX_INDEX_MAX_RECENT);
+      goto done;
+    }
+
+  for (iter = 0; iter < tm->n_iterations; iter++)
+    {
+      op = test_random (tm) % 8;
+      switch (op)
+	{
+	case 0: case 1: case 2:
+	  c = test_random (tm) % n_users;
+	  asn_user_key_prefix_index_add (x, keys[c], refs[c]);
+	  is_member = clib_bitmap_set (is_member, c, 1);
+	  break;
+
+	case 3: case 4:
+	  c = test_random (tm) % n_users;
+	  asn_user_key_prefix_index_del (x, keys[c], refs[c]);
+	  is_member = clib_bitmap_set (is_member, c, 0);
+	  break;
+
+	case 5: case 6:
+	  /* Batches repeat elements and include members (or non-members for deletes). */
+	  n = test_random (tm) % 512;
+	  vec_reset_length (elts);
+	  for (i = 0; i < n; i++)
+	    {
+	      c = i % 8 == 7 ? c : test_random (tm) % n_users;
+	      vec_add2 (elts, e, 1);
+	      e->key_prefix = asn_user_key_prefix (keys[c]);
+	      e->user_ref_as_uword = refs[c];
+	      is_member = clib_bitmap_set (is_member, c, op == 5);
+	    }
+	  if (op == 5)
+	    asn_user_key_prefix_index_add_multiple (x, elts);
+	  else
+	    asn_user_key_prefix_index_del_multiple (x, elts);
+	  break;
+
+	case 7:
+	  for (i = 1; i < vec_len (x->runs); i++)
+	    if (vec_len (x->runs[i - 1]) < 2 * vec_len (x->runs[i]))
+	      {
+		error = clib_error_return (0, "prefix index: run %d has %d elts, next has %d",
+					   i - 1, vec_len (x->runs[i - 1]), vec_len (x->runs[i]));
+		goto done;
+	      }
+	  if (2 * x->n_deleted_run_elts > x->n_run_elts)
+	    {
+	      error = clib_error_return (0, "prefix index: %d of %d run elts deleted",
+					 x->n_deleted_run_elts, x->n_run_elts);
+	      goto done;
+	    }
+
+	  max_runs = clib_max (max_runs, vec_len (x->runs));
+	  n_checks_with_runs += vec_len (x->runs) > 0 && vec_len (x->recent) > 0;
+
+	  for (i = 0; i < 8; i++)
+	    {
+	      c = test_random (tm) % n_users;
+	      for (j = 0; j < ARRAY_LEN (query_lengths); j++)
+		{
+		  n = query_lengths[j];
+		  rv = asn_users_matching_encrypt_key (am, ASN_TX, keys[c], n, rv);
+		  vec_reset_length (expect);
+		  for (k = 0; k < n_users; k++)
+		    if (clib_bitmap_get (is_member, k) && ! memcmp (keys[k], keys[c], n))
+		      vec_add1 (expect, refs[k]);
+		  vec_sort (rv, (void *) test_uword_compare);
+		  vec_sort (expect, (void *) test_uword_compare);
+		  if (vec_len (rv) != vec_len (expect)
+		      || (vec_len (rv) > 0 && memcmp (rv, expect, vec_bytes (rv))))
+		    {
+		      error = clib_error_return (0, "prefix index: iteration %d, %d byte query matched %d users, expected %d",
+						 iter, n, vec_len (rv), vec_len (expect));
+		      goto done;
+		    }
+		}
+	    }
+	  break;
+	}
+    }
+
+  if (n_checks_with_runs == 0 || max_runs < 2)
+    {
+      error = clib_error_return (0, "prefix index: queries never spanned recent and runs (%d) or multiple runs (%d)",
+				 n_checks_with_runs, max_runs);
+      goto done;
+    }
+
+  if (tm->verbose)
+    clib_warning ("prefix index: ok, %d runs at most", max_runs);
+
+ done:
+  test_users_free (tm, am);
+  vec_free (elts);
+  vec_free (keys);
+  vec_free (user_indices);
+  vec_free (refs);
+  vec_free (rv);
+  vec_free (expect);
+  clib_bitmap_free (is_member);
+  return error;
+}
+
+/* Bulk insert of new keys, repeated keys and keys of existing users: one user per distinct key,
+   key table sized once up front, one prefix index element per user. */
+static clib_error_t * test_users_bulk_insert (test_asn_main_t * tm)
+{
+  clib_error_t * error = 0;
+  asn_main_t _am, * am = &_am;
+  asn_user_type_t * ut = &tm->user_type;
+  asn_user_key_table_t * t = &am->user_ref_by_public_encrypt_key[ASN_TX];
+  asn_user_key_prefix_index_t * x = &am->user_ref_by_public_encrypt_key_prefix[ASN_TX];
+  asn_crypto_public_keys_t * keys = 0, * pk;
+  asn_user_key_prefix_index_elt_t * elts = 0;
+  uword * existing_refs = 0, * refs = 0, * first_refs = 0;
+  uword round, i, j, n_existing = 100, n_new = 2000, n_users, n_elts_before, log2_n_slots;
+
+  memset (am, 0, sizeof (am[0]));
+
+  /* Existing users are added one by one (to recent vector). */
+  vec_resize (keys, n_existing);
+  vec_foreach (pk, keys)
+    {
+      test_random_public_keys (tm, pk);
+      vec_add1 (existing_refs, test_user_ref_as_uword (asn_new_user_with_type (am, ASN_TX, ut->index, pk, 0, 0)));
+    }
+
+  /* New keys; every fourth key repeats an earlier one. */
+  for (i = 0; i < n_new; i++)
+    {
+      vec_add2 (keys, pk, 1);
+      if (i % 4 == 3)
+	pk[0] = keys[n_existing + test_random (tm) % i];
+      else
+	test_random_public_keys (tm, pk);
+    }
+
+  /* Second round inserts same keys again: nothing new. */
+  for (round = 0; round < 2; round++)
+    {
+      n_elts_before = t->n_elts;
+      log2_n_slots = max_log2 (clib_max (2 * (n_elts_before + vec_len (keys)), 16));
+
+      refs = asn_users_bulk_insert (am, ASN_TX, ut->index, keys, refs);
+
+      n_users = pool_elts (ut->user_pool);
+      if (vec_len (refs) != vec_len (keys) || t->n_elts != n_users
+	  || x->n_run_elts - x->n_deleted_run_elts + vec_len (x->recent) != n_users)
+	{
+	  error = clib_error_return (0, "bulk insert: %d refs for %d keys, %d users, %d key table elts, %d prefix index elts",
+				     vec_len (refs), vec_len (keys), n_users, t->n_elts,
+				     x->n_run_elts - x->n_deleted_run_elts + vec_len (x->recent));
+	  goto done;
+	}
+      if (round == 0 && t->log2_n_slots != log2_n_slots)
+	{
+	  error = clib_error_return (0, "bulk insert: key table has 2^%d slots, expected 2^%d sized before insert",
+				     t->log2_n_slots, log2_n_slots);
+	  goto done;
+	}
+      if (round == 0)
+	first_refs = vec_dup (refs);
+      else if (memcmp (refs, first_refs, vec_bytes (refs)))
+	{
+	  error = clib_error_return (0, "bulk insert: refs changed when inserting same keys again");
+	  goto done;
+	}
+
+      for (i = 0; i < vec_len (keys); i++)
+	{
+	  asn_user_t * au = asn_user_with_encrypt_key (am, ASN_TX, keys[i].encrypt_key);
+
+	  if ((i < n_existing && refs[i] != existing_refs[i])
+	      || ! au || test_user_ref_as_uword (au) != refs[i]
+	      || memcmp (&au->crypto_keys.public, &keys[i], sizeof (keys[i]))
+	      || au->private_key_is_valid
+	      || ! test_prefix_query_is (am, keys[i].encrypt_key, 32, refs[i]))
+	    {
+	      error = clib_error_return (0, "bulk insert: round %d, key %d not found or has wrong user", round, i);
+	      goto done;
+	    }
+
+	  /* Repeated keys map to same user. */
+	  for (j = 0; j < i; j++)
+	    if ((refs[j] == refs[i]) != ! memcmp (keys[j].encrypt_key, keys[i].encrypt_key, sizeof (keys[i].encrypt_key)))
+	      {
+		error = clib_error_return (0, "bulk insert: keys %d and %d users do not match keys", j, i);
+		goto done;
+	      }
+	}
+    }
+
+  /* Adding elements already in index (each twice) must not add any. */
+  {
+    uword n_elts = x->n_run_elts - x->n_deleted_run_elts + vec_len (x->recent);
+    asn_user_key_prefix_index_elt_t * e;
+
+    for (i = 0; i < 2 * vec_len (keys); i++)
+      {
+	vec_add2 (elts, e, 1);
+	e->key_prefix = asn_user_key_prefix (keys[i / 2].encrypt_key);
+	e->user_ref_as_uword = refs[i / 2];
+      }
+    asn_user_key_prefix_index_add_multiple (x, elts);
+    if (x->n_run_elts - x->n_deleted_run_elts + vec_len (x->recent) != n_elts)
+      {
+	error = clib_error_return (0, "bulk insert: add multiple of existing elements grew index from %d to %d elts",
+				   n_elts, x->n_run_elts - x->n_deleted_run_elts + vec_len (x->recent));
+	goto done;
+      }
+  }
+
+  if (tm->verbose)
+    clib_warning ("bulk insert: ok, %d users for %d keys", pool_elts (ut->user_pool), vec_len (keys));
+
+ done:
+  test_users_free (tm, am);
+  vec_free (keys);
+  vec_free (existing_refs);
+  vec_free (refs);
+  vec_free (first_refs);
+  vec_free (elts);
+  return error;
+}
+
+static int test_u64_compare_descending (u64 * a, u64 * b)
+{ return a[0] > b[0] ? -1 : a[0] < b[0]; }
+
+/* Eviction keeps most recently used users; evicted and re-keyed users are gone from both
+   key indices and evicted users can be learned again. */
+static clib_error_t * test_user_eviction (test_asn_main_t * tm)
+{
+  clib_error_t * error = 0;
+  asn_main_t _am, * am = &_am;
+  asn_user_type_t * ut = &tm->user_type;
+  asn_crypto_public_keys_t * keys = 0;
+  asn_user_t * au;
+  u64 * last_use = 0, * sorted = 0, min_survivor_last_use;
+  u32 * user_index = 0;
+  uword * keep = 0;
+  uword i, j, n_users = 256, max_users = 64, n_evicted, is_evicted;
+
+  memset (am, 0, sizeof (am[0]));
+
+  vec_resize (keys, n_users);
+  vec_resize (last_use, n_users);
+  vec_resize (user_index, n_users);
+  for (i = 0; i < n_users; i++)
+    {
+      test_random_public_keys (tm, &keys[i]);
+      au = asn_new_user_with_type (am, ASN_TX, ut->index, &keys[i], /* private */ 0, /* random private */ 0);
+      last_use[i] = au->last_use;
+      user_index[i] = au->index;
+    }
+
+  /* Find random users by key. */
+  for (i = 0; i < 4 * n_users; i++)
+    {
+      j = test_random (tm) % n_users;
+      au = asn_user_with_encrypt_key (am, ASN_TX, keys[j].encrypt_key);
+      if (! au || au->index != user_index[j])
+	{
+	  error = clib_error_return (0, "evict: lookup of user %d failed", j);
+	  goto done;
+	}
+      last_use[j] = au->last_use;
+    }
+
+  /* Re-keying a user must remove its old key from both indices. */
+  {
+    asn_crypto_public_keys_t old = keys[1];
+    au = asn_user_by_index_and_type (user_index[1], ut->index);
+    test_random_public_keys (tm, &keys[1]);
+    asn_user_update_keys (am, ASN_TX, au, &keys[1], /* private */ 0, /* random private */ 0);
+    if (asn_user_with_encrypt_key (am, ASN_TX, old.encrypt_key)
+	|| ! test_prefix_query_is (am, old.encrypt_key, 8, ~0)
+	|| asn_user_with_encrypt_key (am, ASN_TX, keys[1].encrypt_key) != au
+	|| ! test_prefix_query_is (am, keys[1].encrypt_key, 8, test_user_ref_as_uword (au)))
+      {
+	error = clib_error_return (0, "evict: stale index entries after re-keying user 1");
+	goto done;
+      }
+    last_use[1] = au->last_use;
+  }
+
+  /* First user is kept even if least recently used. */
+  keep = clib_bitmap_ori (keep, user_index[0]);
+  n_evicted = asn_users_evict (am, ut->index, max_users, keep);
+  if (n_evicted != n_users - max_users || pool_elts (ut->user_pool) != max_users)
+    {
+      error = clib_error_return (0, "evict: evicted %d users leaving %d, expected %d leaving %d",
+				 n_evicted, pool_elts (ut->user_pool), n_users - max_users, max_users);
+      goto done;
+    }
+
+  /* Survivors are kept user plus most recently used others. */
+  for (i = 1; i < n_users; i++)
+    vec_add1 (sorted, last_use[i]);
+  vec_sort (sorted, (void *) test_u64_compare_descending);
+  min_survivor_last_use = sorted[max_users - 2];
+
+  for (i = 0; i < n_users; i++)
+    {
+      is_evicted = i > 0 && last_use[i] < min_survivor_last_use;
+      au = asn_user_with_encrypt_key (am, ASN_TX, keys[i].encrypt_key);
+      if ((au == 0) != is_evicted)
+	{
+	  error = clib_error_return (0, "evict: user %d last use %Ld %s, expected %s",
+				     i, last_use[i], au ? "survived" : "evicted",
+				     is_evicted ? "evicted" : "survived");
+	  goto done;
+	}
+      if (! test_prefix_query_is (am, keys[i].encrypt_key, 8, au ? test_user_ref_as_uword (au) : ~0)
+	  || ! test_prefix_query_is (am, keys[i].encrypt_key, 32, au ? test_user_ref_as_uword (au) : ~0))
+	{
+	  error = clib_error_return (0, "evict: prefix query for %s user %d wrong",
+				     is_evicted ? "evicted" : "surviving", i);
+	  goto done;
+	}
+    }
+
+  /* Learn evicted users again. */
+  for (i = 0; i < n_users; i++)
+    {
+      if (asn_user_with_encrypt_key (am, ASN_TX, keys[i].encrypt_key))
+	continue;
+      au = asn_new_user_with_type (am, ASN_TX, ut->index, &keys[i], /* private */ 0, /* random private */ 0);
+      if (asn_user_with_encrypt_key (am, ASN_TX, keys[i].encrypt_key) != au
+	  || ! test_prefix_query_is (am, keys[i].encrypt_key, 32, test_user_ref_as_uword (au)))
+	{
+	  error = clib_error_return (0, "evict: user %d not found after learning again", i);
+	  goto done;
+	}
+    }
+  if (pool_elts (ut->user_pool) != n_users)
+    {
+      error = clib_error_return (0, "evict: %d users after learning again, expected %d",
+				 pool_elts (ut->user_pool), n_users);
+      goto done;
+    }
+
+  if (tm->verbose)
+    clib_warning ("evict: ok");
+
+ done:
+  test_users_free (tm, am);
+  vec_free (keys);
+  vec_free (last_use);
+  vec_free (sorted);
+  vec_free (user_index);
+  clib_bitmap_free (keep);
+  return error;
+}
+
+/* Steady exec/ack traffic must re-use frames once cache is warm. */
+static clib_error_t * test_frame_cache (test_asn_main_t * tm)
+{
+  clib_error_t * error = 0;
+  asn_main_t _am, * am = &_am;
+  asn_socket_t _as, * as = &_as;
+  asn_pdu_frame_cache_t * c;
+  asn_pdu_t * p;
+  u8 * cmd = 0;
+  u64 n_allocs_after_warm_up = 0;
+  uword iter, i, n_pdus, max_cmd_bytes = 3 * 4000;
+
+  memset (am, 0, sizeof (am[0]));
+  memset (as, 0, sizeof (as[0]));
+
+  /* PDUs queue while corked; transmit frees them as asn_socket_tx would. */
+  asn_socket_cork (as);
+
+  for (iter = 0; iter < tm->n_iterations; iter++)
+    {
+      /* Up to 4 PDUs of up to 3 frames each in flight.  First iteration is
+	 worst case so it alone warms up cache. */
+      n_pdus = iter == 0 ? 4 : 1 + test_random (tm) % 4;
+      for (i = 0; i < n_pdus; i++)
+	{
+	  vec_validate (cmd, iter == 0 ? max_cmd_bytes : test_random (tm) % max_cmd_bytes);
+	  memset (cmd, 'x', vec_len (cmd));
+	  error = asn_socket_exec (am, as, /* ack handler */ 0, "echo %v", cmd);
+	  if (error)
+	    goto done;
+	  vec_reset_length (cmd);
+	}
+
+      vec_foreach (p, as->tx_pdus)
+	asn_pdu_free (p);
+      vec_reset_length (as->tx_pdus);
+      vec_reset_length (am->tx_pending_socket_indices);
+
+      /* Acks free exec handler slots. */
+      for (i = 0; i < vec_len (as->exec_ack_handler_pool); i++)
+	if (! pool_is_free_index (as->exec_ack_handler_pool, i))
+	  pool_put_index (as->exec_ack_handler_pool, i);
+
+      c = as->tx_frame_cache;
+      if (iter == 0)
+	n_allocs_after_warm_up = c->n_frame_allocs;
+      else if (c->n_frame_allocs != n_allocs_after_warm_up)
+	{
+	  error = clib_error_return (0, "frame cache: iteration %d, %U after warm up %Ld allocs",
+				     iter, format_asn_pdu_frame_cache, c, n_allocs_after_warm_up);
+	  goto done;
+	}
+    }
+
+  c = as->tx_frame_cache;
+  if (c->n_frame_reuses == 0)
+    {
+      error = clib_error_return (0, "frame cache: no reuses, %U", format_asn_pdu_frame_cache, c);
+      goto done;
+    }
+
+  /* Every frame allocated is freed. */
+  {
+    asn_pdu_frame_cache_t save;
+    asn_pdu_frame_cache_free (c);
+    save = c[0];
+    if (save.n_frame_allocs != save.n_frame_frees)
+      {
+	error = clib_error_return (0, "frame cache: leak, %U", format_asn_pdu_frame_cache, &save);
+	goto done;
+      }
+    if (tm->verbose)
+      clib_warning ("frame cache: ok, %U", format_asn_pdu_frame_cache, &save);
+  }
+
+ done:
+  vec_free (cmd);
+  asn_socket_free (as);
+  vec_free (am->tx_pending_socket_indices);
+  vec_free (am->tx_exec_command_buffer);
+  return error;
+}
+
+/* Random lookups of more key pairs than cache holds: repeated pairs hit, new pairs miss and evict
+   least recently used entry once full; cached secrets always match crypto_box_beforenm. */
+static clib_error_t * test_shared_secret_cache (test_asn_main_t * tm)
+{
+  clib_error_t * error = 0;
+  asn_app_main_t _am, * am = &_am;
+  asn_app_shared_secret_cache_t * c = &am->rx_shared_secret_cache;
+  asn_app_message_public_key_pair_t * kps = 0;
+  u8 (* secrets)[crypto_box_shared_secret_bytes] = 0;
+  u8 dst_private_key[crypto_box_private_key_bytes];
+  u64 * last_use = 0, n_hits = 0, n_misses = 0, n_evictions = 0;
+  uword i, j, iter, n_pairs = 12, n_cached = 0, is_hit;
+  u8 * s;
+
+  memset (am, 0, sizeof (am[0]));
+  c->max_entries = 8;
+
+  test_random_bytes (tm, dst_private_key, sizeof (dst_private_key));
+  vec_resize (kps, n_pairs);
+  vec_resize (secrets, n_pairs);
+  vec_resize (last_use, n_pairs);
+  for (i = 0; i < n_pairs; i++)
+    {
+      /* Half the pairs share source key with previous pair: only destination differs. */
+      if (i % 2)
+	memcpy (kps[i].src, kps[i - 1].src, sizeof (kps[i].src));
+      else
+	test_random_bytes (tm, kps[i].src, sizeof (kps[i].src));
+      test_random_bytes (tm, kps[i].dst, sizeof (kps[i].dst));
+      crypto_box_beforenm (secrets[i], kps[i].src, dst_private_key);
+    }
+
+  for (iter = 0; iter < tm->n_iterations; iter++)
+    {
+      /* First pass visits every pair in order so cache fills then evicts. */
+      i = iter < n_pairs ? iter : test_random (tm) % n_pairs;
+
+      /* Model: hit when pair is still cached; once full a miss evicts least recently used pair. */
+      is_hit = last_use[i] != 0;
+      if (! is_hit)
+	{
+	  if (n_cached == c->max_entries)
+	    {
+	      uword lru = ~0;
+	      for (j = 0; j < n_pairs; j++)
+		if (last_use[j] != 0 && (lru == ~0 || last_use[j] < last_use[lru]))
+		  lru = j;
+	      last_use[lru] = 0;
+	      n_evictions++;
+	    }
+	  else
+	    n_cached++;
+	}
+      last_use[i] = iter + 1;
+      n_hits += is_hit;
+      n_misses += ! is_hit;
+
+      s = asn_app_shared_secret_for_key_pair (am, &kps[i], dst_private_key);
+      if (memcmp (s, secrets[i], sizeof (secrets[i])))
+	{
+	  error = clib_error_return (0, "shared secret: iteration %d, pair %d secret differs from crypto_box_beforenm", iter, i);
+	  goto done;
+	}
+      if (c->n_hits != n_hits || c->n_misses != n_misses || c->n_evictions != n_evictions)
+	{
+	  error = clib_error_return (0, "shared secret: iteration %d, pair %d, %U, expected %Ld hits %Ld misses %Ld evictions",
+				     iter, i, format_asn_app_shared_secret_cache, c, n_hits, n_misses, n_evictions);
+	  goto done;
+	}
+    }
+
+  if (n_hits == 0 || n_evictions == 0)
+    {
+      error = clib_error_return (0, "shared secret: too few iterations, %U", format_asn_app_shared_secret_cache, c);
+      goto done;
+    }
+
+  if (tm->verbose)
+    clib_warning ("shared secret: ok, %U", format_asn_app_shared_secret_cache, c);
+
+ done:
+  asn_app_shared_secret_cache_free (c);
+  vec_free (kps);
+  vec_free (secrets);
+  vec_free (last_use);
+  return error;
+}
+
+/* Socket in asn main's socket pool transmitting into one end of a non-blocking socket pair.
+   Test reads what was sent from *PEER_FD. */
+static clib_error_t * test_socket_pair_create (asn_main_t * am, asn_socket_t ** result, int * peer_fd)
+{
+  asn_socket_t * socket_pool = am->websocket_main.user_socket_pool, * as;
+  int fds[2];
+
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    return clib_error_return_unix (0, "socketpair");
+  fcntl (fds[0], F_SETFL, O_NONBLOCK);
+  fcntl (fds[1], F_SETFL, O_NONBLOCK);
+
+  pool_get (socket_pool, as);
+  am->websocket_main.user_socket_pool = socket_pool;
+  memset (as, 0, sizeof (as[0]));
+  as->websocket_socket.index = as - socket_pool;
+  as->websocket_socket.clib_socket.fd = fds[0];
+
+  *result = as;
+  *peer_fd = fds[1];
+  return 0;
+}
+
+/* Appends everything available on FD to *DATA; returns zero at end of file. */
+static uword test_socket_read_available (int fd, u8 ** data)
+{
+  u8 buf[4096];
+  ssize_t n;
+  while ((n = read (fd, buf, sizeof (buf))) > 0)
+    vec_add (data[0], buf, n);
+  return n != 0;
+}
+
+/* Number of bytes at start of DATA made up of whole websocket frames. */
+static uword test_websocket_whole_frame_bytes (u8 * data)
+{
+  uword i = 0, j, l, n_header;
+
+  while (i + 2 <= vec_len (data))
+    {
+      l = data[i + 1] & 0x7f;
+      n_header = 2;
+      if (l == 126)
+	{
+	  if (i + 4 > vec_len (data))
+	    break;
+	  l = (data[i + 2] << 8) | data[i + 3];
+	  n_header = 4;
+	}
+      else if (l == 127)
+	{
+	  if (i + 10 > vec_len (data))
+	    break;
+	  for (l = j = 0; j < 8; j++)
+	    l = (l << 8) | data[i + 2 + j];
+	  n_header = 10;
+	}
+      if (data[i + 1] & 0x80)
+	n_header += 4;		/* mask */
+      if (i + n_header + l > vec_len (data))
+	break;
+      i += n_header + l;
+    }
+
+  return i;
+}
+
+typedef struct {
+  asn_blob_writer_t blob_writer;
+
+  /* Contents size and offset where reads start to fail (~0 for never). */
+  u64 n_bytes_in_blob;
+  u64 n_bytes_before_read_error;
+
+  /* Set to number of bytes read when writer is freed. */
+  u64 * n_bytes_read_at_free;
+} test_blob_writer_t;
+
+static clib_error_t * test_blob_writer_read (asn_blob_writer_t * bw, u8 * data, u32 n_bytes, u32 * n_bytes_read)
+{
+  test_blob_writer_t * tbw = CONTAINER_OF (bw, test_blob_writer_t, blob_writer);
+  u64 n;
+
+  if (bw->n_bytes_read >= tbw->n_bytes_before_read_error)
+    return clib_error_return (0, "test read error");
+
+  n = clib_min (n_bytes, tbw->n_bytes_in_blob - bw->n_bytes_read);
+  n = clib_min (n, tbw->n_bytes_before_read_error - bw->n_bytes_read);
+  memset (data, bw->n_bytes_read, n);
+  *n_bytes_read = n;
+  return 0;
+}
+
+static void test_blob_writer_free (asn_blob_writer_t * bw)
+{
+  test_blob_writer_t * tbw = CONTAINER_OF (bw, test_blob_writer_t, blob_writer);
+  tbw->n_bytes_read_at_free[0] = bw->n_bytes_read;
+}
+
+static asn_blob_writer_t *
+test_blob_writer_create (u64 n_bytes_in_blob, u64 n_bytes_before_read_error, u64 * n_bytes_read_at_free)
+{
+  test_blob_writer_t * tbw = asn_blob_writer_create_with_function_in_container
+    (test_blob_writer_read, sizeof (tbw[0]), STRUCT_OFFSET_OF (test_blob_writer_t, blob_writer));
+  tbw->blob_writer.free = test_blob_writer_free;
+  tbw->n_bytes_in_blob = n_bytes_in_blob;
+  tbw->n_bytes_before_read_error = n_bytes_before_read_error;
+  tbw->n_bytes_read_at_free = n_bytes_read_at_free;
+  return &tbw->blob_writer;
+}
+
+/* Blob much larger than transmit buffer limit is sent across many polls with bounded buffer;
+   read error closes socket right away leaving peer only whole websocket frames. */
+static clib_error_t * test_blob_writer (test_asn_main_t * tm)
+{
+  clib_error_t * error = 0;
+  asn_main_t _am, * am = &_am;
+  asn_socket_t * as;
+  asn_crypto_public_keys_t keys;
+  asn_user_t * au;
+  u8 * rx = 0;
+  u64 n_bytes_read = 0, n_bytes_in_blob = 4 << 20;
+  u32 socket_index, max_tx_buffer_bytes = 16 << 10;
+  uword n_polls;
+  int peer_fd = -1;
+
+  memset (am, 0, sizeof (am[0]));
+  am->tx_coalesce_max_websocket_frame_bytes = 8 << 10;
+  am->tx_blob_writer_max_buffer_bytes = max_tx_buffer_bytes;
+  error = asn_main_init (am, sizeof (asn_socket_t), /* user_socket_offset_of_asn_socket */ 0);
+  if (error)
+    goto done;
+
+  test_random_public_keys (tm, &keys);
+  au = asn_new_user_with_type (am, ASN_TX, tm->user_type.index, &keys, /* private */ 0, /* random private */ 0);
+
+  error = test_socket_pair_create (am, &as, &peer_fd);
+  if (error)
+    goto done;
+
+  /* Large blob: corked so nothing is sent until first poll. */
+  asn_socket_cork (as);
+  error = asn_save_blob_with_writer (am, as, au, test_blob_writer_create (n_bytes_in_blob, ~0ULL, &n_bytes_read),
+				     "test/large");
+  if (error)
+    goto done;
+
+  for (n_polls = 0; vec_len (as->tx_pdus) > 0; n_polls++)
+    {
+      if (n_polls > n_bytes_in_blob)
+	{
+	  error = clib_error_return (0, "blob writer: no progress after %d polls", n_polls);
+	  goto done;
+	}
+
+      test_socket_read_available (peer_fd, &rx);
+      error = asn_socket_tx (am, as);
+      if (error)
+	goto done;
+
+      if (vec_len (as->websocket_socket.clib_socket.tx_buffer) > max_tx_buffer_bytes + (1 << ASN_PDU_FRAME_LOG2_MAX_BYTES)
+	  || (vec_len (as->tx_pdus) > 0 && ! as->tx_is_pending))
+	{
+	  error = clib_error_return (0, "blob writer: poll %d, %d bytes buffered, pending %d",
+				     n_polls, vec_len (as->websocket_socket.clib_socket.tx_buffer), as->tx_is_pending);
+	  goto done;
+	}
+    }
+  test_socket_read_available (peer_fd, &rx);
+
+  if (n_polls < 2 || n_bytes_read != n_bytes_in_blob
+      || vec_len (rx) + vec_len (as->websocket_socket.clib_socket.tx_buffer) < n_bytes_in_blob)
+    {
+      error = clib_error_return (0, "blob writer: %d polls, read %Ld of %Ld bytes, %d bytes sent",
+				 n_polls, n_bytes_read, n_bytes_in_blob, vec_len (rx));
+      goto done;
+    }
+
+  /* Failing reader: coalesced frames are pending when read fails.  Everything peer received
+     on socket (both blobs) must parse as whole websocket frames. */
+  socket_index = as->websocket_socket.index;
+  error = asn_save_blob_with_writer (am, as, au, test_blob_writer_create (n_bytes_in_blob, 10 << 10, &n_bytes_read),
+				     "test/fail");
+  if (error)
+    goto done;
+  error = asn_socket_tx (am, as);
+  if (! error)
+    {
+      error = clib_error_return (0, "blob writer: read error not reported");
+      goto done;
+    }
+  clib_error_free (error);
+
+  if (! pool_is_free_index (am->websocket_main.user_socket_pool, socket_index))
+    {
+      error = clib_error_return (0, "blob writer: socket not closed after read error");
+      goto done;
+    }
+
+  while (test_socket_read_available (peer_fd, &rx))
+    ;
+  if (n_bytes_read != 10 << 10 || test_websocket_whole_frame_bytes (rx) != vec_len (rx))
+    {
+      error = clib_error_return (0, "blob writer: read %Ld bytes before error, %d of %d bytes in whole websocket frames",
+				 n_bytes_read, test_websocket_whole_frame_bytes (rx), vec_len (rx));
+      goto done;
+    }
+
+  if (tm->verbose)
+    clib_warning ("blob writer: ok, %d polls", n_polls);
+
+ done:
+  if (peer_fd >= 0)
+    close (peer_fd);
+  vec_free (rx);
+  test_users_free (tm, am);
+  asn_main_free (am);
+  return error;
+}
+
+typedef struct {
+  /* Calls to stream begin, end (normal and abort) and plain handler. */
+  u32 n_begin, n_end, n_abort, n_handler;
+
+  /* Contents received by stream data or handler. */
+  u8 * contents;
+} test_rx_blob_t;
+
+static test_rx_blob_t test_rx_stream_blob, test_rx_spill_blob;
+
+asn_blob_type_t test_rx_stream_blob_type, test_rx_spill_blob_type;
+
+static test_rx_blob_t * test_rx_blob_for_handler (asn_blob_handler_t * bh)
+{ return bh->blob_type == &test_rx_stream_blob_type ? &test_rx_stream_blob : &test_rx_spill_blob; }
+
+static clib_error_t * test_rx_blob_handler (asn_blob_handler_t * bh, asn_pdu_blob_t * blob, u32 n_bytes_in_pdu)
+{
+  test_rx_blob_t * t = test_rx_blob_for_handler (bh);
+  uword n_header_bytes = sizeof (blob[0]) + blob->n_name_bytes;
+  t->n_handler++;
+  vec_add (t->contents, (u8 *) blob + n_header_bytes, n_bytes_in_pdu - n_header_bytes);
+  return 0;
+}
+
+static clib_error_t * test_rx_blob_stream_begin (asn_blob_handler_t * bh, asn_pdu_blob_t * blob)
+{
+  test_rx_blob_for_handler (bh)->n_begin++;
+  return 0;
+}
+
+static clib_error_t * test_rx_blob_stream_data (asn_blob_handler_t * bh, u8 * data, u32 n_data_bytes)
+{
+  test_rx_blob_t * t = test_rx_blob_for_handler (bh);
+  vec_add (t->contents, data, n_data_bytes);
+  return 0;
+}
+
+static clib_error_t * test_rx_blob_stream_end (asn_blob_handler_t * bh, u32 is_abort)
+{
+  test_rx_blob_t * t = test_rx_blob_for_handler (bh);
+  if (is_abort)
+    t->n_abort++;
+  else
+    t->n_end++;
+  return 0;
+}
+
+asn_blob_type_t test_rx_stream_blob_type = {
+  .path = "test/stream",
+  .handler = test_rx_blob_handler,
+  .stream_begin = test_rx_blob_stream_begin,
+  .stream_data = test_rx_blob_stream_data,
+  .stream_end = test_rx_blob_stream_end,
+};
+CLIB_INIT_ADD (asn_blob_type_t, test_rx_stream_blob_type);
+
+/* No stream functions: large PDUs are spilled. */
+asn_blob_type_t test_rx_spill_blob_type = {
+  .path = "test/spill",
+  .handler = test_rx_blob_handler,
+};
+CLIB_INIT_ADD (asn_blob_type_t, test_rx_spill_blob_type);
+
+/* Blob PDU with given name, version and N_CONTENT_BYTES of patterned contents. */
+static u8 * test_rx_blob_pdu (char * name, u8 version, uword n_content_bytes)
+{
+  asn_pdu_blob_t * blob;
+  u8 * pdu = 0, * c;
+  uword i, n_name_bytes = strlen (name);
+
+  vec_validate (pdu, sizeof (blob[0]) + n_name_bytes + n_content_bytes - 1);
+  blob = (void *) pdu;
+  blob->header.version = version;
+  blob->header.id = ASN_PDU_blob;
+  blob->n_name_bytes = n_name_bytes;
+  memcpy (blob->name, name, n_name_bytes);
+  c = blob->name + n_name_bytes;
+  for (i = 0; i < n_content_bytes; i++)
+    c[i] = 7*i + 3;
+  return pdu;
+}
+
+static uword test_rx_blob_contents_match (test_rx_blob_t * t, u8 * pdu)
+{
+  asn_pdu_blob_t * blob = (void *) pdu;
+  uword n_header_bytes = sizeof (blob[0]) + blob->n_name_bytes;
+  return (vec_len (t->contents) == vec_len (pdu) - n_header_bytes
+	  && ! memcmp (t->contents, pdu + n_header_bytes, vec_len (t->contents)));
+}
+
+/* Encrypts bytes [I0, I1) of PDU as frames of at most N_BYTES_PER_FRAME user data bytes and
+   feeds each frame to socket's receive side as its own websocket payload. */
+static clib_error_t *
+test_rx_pdu_frames (asn_main_t * am, asn_socket_t * as, u8 * tx_nonce,
+		    u8 * pdu, uword i0, uword i1, uword n_bytes_per_frame)
+{
+  clib_error_t * error = 0;
+  asn_pdu_frame_t * f;
+  u8 * frame = 0;
+  uword n, is_last_frame;
+
+  vec_validate (frame, STRUCT_OFFSET_OF (asn_pdu_frame_t, user_data) + n_bytes_per_frame - 1);
+  f = (void *) frame;
+  while (i0 < i1)
+    {
+      n = clib_min (n_bytes_per_frame, i1 - i0);
+      is_last_frame = i0 + n == vec_len (pdu);
+      crypto_box_detached_afternm (f->user_data, f->user_data_authentication, pdu + i0, n,
+				   tx_nonce, as->ephemeral_crypto_state.shared_secret);
+      asn_crypto_increment_nonce (tx_nonce, 2);
+      f->n_bytes_that_follow_and_more_flag_network_byte_order
+	= clib_host_to_net_u16 ((n + sizeof (f->user_data_authentication))
+				| ((is_last_frame == 0) << ASN_PDU_FRAME_LOG2_MORE_FLAG));
+      error = am->websocket_main.rx_frame_payload (&am->websocket_main, &as->websocket_socket,
+						   frame, STRUCT_OFFSET_OF (asn_pdu_frame_t, user_data) + n);
+      if (error)
+	break;
+      i0 += n;
+    }
+
+  vec_free (frame);
+  return error;
+}
+
+/* Multi-frame blobs: streamed to blob types with stream functions (aborted when socket closes
+   mid-blob) and spilled to temporary file otherwise.  Both learn peer's frame size from first frame. */
+static clib_error_t * test_rx_stream_and_spill (test_asn_main_t * tm)
+{
+  clib_error_t * error = 0;
+  asn_main_t _am, * am = &_am;
+  asn_socket_t * as;
+  test_rx_blob_t * stream = &test_rx_stream_blob, * spill = &test_rx_spill_blob;
+  u8 tx_nonce[crypto_box_nonce_bytes];
+  u8 * pdu = 0;
+  u32 n_bytes_per_frame = 1000, spill_bytes = 16 << 10;
+  int peer_fd = -1;
+
+  memset (am, 0, sizeof (am[0]));
+  am->rx_log2_max_frame_bytes = 14;
+  am->rx_pdu_spill_bytes = spill_bytes;
+  error = asn_main_init (am, sizeof (asn_socket_t), /* user_socket_offset_of_asn_socket */ 0);
+  if (error)
+    goto done;
+
+  memset (stream, 0, sizeof (stream[0]));
+  memset (spill, 0, sizeof (spill[0]));
+
+  error = test_socket_pair_create (am, &as, &peer_fd);
+  if (error)
+    goto done;
+  as->session_state = ASN_SESSION_STATE_established;
+  test_random_bytes (tm, as->ephemeral_crypto_state.shared_secret, sizeof (as->ephemeral_crypto_state.shared_secret));
+  memcpy (tx_nonce, as->ephemeral_crypto_state.nonce[ASN_RX], sizeof (tx_nonce));
+
+  /* Streamed: header and contents spread over many frames. */
+  pdu = test_rx_blob_pdu ("test/stream", /* version: 16k frames */ 2, 64 << 10);
+  error = test_rx_pdu_frames (am, as, tx_nonce, pdu, 0, vec_len (pdu), n_bytes_per_frame);
+  if (error)
+    goto done;
+  if (stream->n_begin != 1 || stream->n_end != 1 || stream->n_abort != 0 || stream->n_handler != 0
+      || ! test_rx_blob_contents_match (stream, pdu) || as->tx_log2_frame_bytes != 14)
+    {
+      error = clib_error_return (0, "stream: begin %d end %d abort %d handler %d, %d contents bytes, log2 frame bytes %d",
+				 stream->n_begin, stream->n_end, stream->n_abort, stream->n_handler,
+				 vec_len (stream->contents), as->tx_log2_frame_bytes);
+      goto done;
+    }
+
+  /* Spilled: file holds PDU once threshold is passed; handler sees whole PDU at end. */
+  vec_free (pdu);
+  pdu = test_rx_blob_pdu ("test/spill", /* version: 8k frames */ 1, 64 << 10);
+  error = test_rx_pdu_frames (am, as, tx_nonce, pdu, 0, spill_bytes + n_bytes_per_frame, n_bytes_per_frame);
+  if (error)
+    goto done;
+  if (! as->rx_pdu_is_spilled || vec_len (as->rx_pdu) != 0 || spill->n_handler != 0 || as->tx_log2_frame_bytes != 13)
+    {
+      error = clib_error_return (0, "spill: not spilled after %d bytes, %d bytes in memory, log2 frame bytes %d",
+				 spill_bytes + n_bytes_per_frame, vec_len (as->rx_pdu), as->tx_log2_frame_bytes);
+      goto done;
+    }
+  error = test_rx_pdu_frames (am, as, tx_nonce, pdu, spill_bytes + n_bytes_per_frame, vec_len (pdu), n_bytes_per_frame);
+  if (error)
+    goto done;
+  if (as->rx_pdu_is_spilled || spill->n_handler != 1 || ! test_rx_blob_contents_match (spill, pdu))
+    {
+      error = clib_error_return (0, "spill: handler %d, %d contents bytes", spill->n_handler, vec_len (spill->contents));
+      goto done;
+    }
+
+  /* Socket closed mid-stream aborts. */
+  vec_free (pdu);
+  vec_reset_length (stream->contents);
+  pdu = test_rx_blob_pdu ("test/stream", 0, 64 << 10);
+  error = test_rx_pdu_frames (am, as, tx_nonce, pdu, 0, vec_len (pdu) / 2, n_bytes_per_frame);
+  if (error)
+    goto done;
+  websocket_close (&am->websocket_main, &as->websocket_socket);
+  if (stream->n_begin != 2 || stream->n_end != 1 || stream->n_abort != 1)
+    {
+      error = clib_error_return (0, "stream abort: begin %d end %d abort %d",
+				 stream->n_begin, stream->n_end, stream->n_abort);
+      goto done;
+    }
+
+  if (tm->verbose)
+    clib_warning ("rx stream and spill: ok");
+
+ done:
+  if (peer_fd >= 0)
+    close (peer_fd);
+  vec_free (pdu);
+  asn_main_free (am);
+  vec_free (stream->contents);
+  vec_free (spill->contents);
+  return error;
+}
+
+int test_asn_main (unformat_input_t * input)
+{
+  test_asn_main_t _tm, * tm = &_tm;
+  clib_error_t * error = 0;
+
+  memset (tm, 0, sizeof (tm[0]));
+  tm->seed = 0x12345678;
+  tm->n_iterations = 1000;
+
+  tm->user_type.name = "test";
+  tm->user_type.user_type_n_bytes = sizeof (asn_user_t);
+  tm->user_type.user_type_offset_of_asn_user = 0;
+  asn_register_user_type (&tm->user_type);
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "seed %d", &tm->seed))
+	;
+      else if (unformat (input, "iter %d", &tm->n_iterations))
+	;
+      else if (unformat (input, "verbose"))
+	tm->verbose = 1;
+      else
+	{
+	  error = clib_error_return (0, "parse error: `%U'", format_unformat_error, input);
+	  goto done;
+	}
+    }
+
+  error = test_frame_cache (tm);
+  if (error)
+    goto done;
+
+  error = test_user_key_table (tm);
+  if (error)
+    goto done;
+
+  error = test_user_key_prefix_index (tm);
+  if (error)
+    goto done;
+
+  error = test_users_bulk_insert (tm);
+  if (error)
+    goto done;
+
+  error = test_user_eviction (tm);
+  if (error)
+    goto done;
+
+  error = test_blob_writer (tm);
+  if (error)
+    goto done;
+
+  error = test_rx_stream_and_spill (tm);
+  if (error)
+    goto done;
+
+  error = test_shared_secret_cache (tm);
+  if (error)
+    goto done;
+
+ done:
+  if (error)
+    clib_error_report (error);
+  return error ? 1 : 0;
+}
+
+int main (int argc, char * argv[])
+{
+  unformat_input_t i;
+  int ret;
+
+  unformat_init_command_line (&i, argv);
+  ret = test_asn_main (&i);
+  unformat_free (&i);
+
+  return ret;
+}
@@ -0,0 +1,254 @@
+#include <uclib/uclib.h>
+#include <casn/tweetnacl.h>
+
+/* Crypto micro benchmarks.  Prints one CSV line (or JSON object with `json')
+   per primitive, implementation and message size. */
+
+typedef struct asnbench_crypto_main_t asnbench_crypto_main_t;
+
+typedef void (asnbench_crypto_function_t) (asnbench_crypto_main_t * bm, uword n_bytes);
+
+struct asnbench_crypto_main_t {
+  /* Each measurement runs at least this long. */
+  f64 min_time;
+
+  u32 is_json;
+
+  u8 * clear_text, * cipher_text;
+  u8 key[32], nonce[24], authentication[16];
+
+  u8 box_public[crypto_box_public_key_bytes], box_private[crypto_box_private_key_bytes];
+
+  u8 sign_public[crypto_sign_public_key_bytes], sign_private[crypto_sign_private_key_bytes];
+  u8 signed_message[crypto_sign_signature_bytes + 32];
+  u64 n_signed_message_bytes;
+};
+
+/* Sizes from smallest frame to full default frame payload plus a large blob. */
+static u32 asnbench_crypto_sizes[] = { 64, 256, 1024, 4080, 64 << 10, };
+
+static void
+asnbench_crypto_run (asnbench_crypto_main_t * bm,
+		     char * primitive, char * implementation,
+		     asnbench_crypto_function_t * f, uword n_bytes)
+{
+  uword i, n_ops;
+  f64 t[2], dt;
+  u64 c[2];
+  f64 ops_per_sec, cycles_per_op;
+
+  /* Warm up caches and pick implementation. */
+  f (bm, n_bytes);
+
+  n_ops = 1;
+  while (1)
+    {
+      t[0] = unix_time_now ();
+      c[0] = clib_cpu_time_now ();
+      for (i = 0; i < n_ops; i++)
+	f (bm, n_bytes);
+      c[1] = clib_cpu_time_now ();
+      t[1] = unix_time_now ();
+      dt = t[1] - t[0];
+      if (dt >= bm->min_time)
+	break;
+      n_ops *= 2;
+    }
+
+  ops_per_sec = n_ops / dt;
+  cycles_per_op = (f64) (c[1] - c[0]) / n_ops;
+
+  if (bm->is_json)
+    fformat (stdout, "{\"primitive\": \"%s\", \"implementation\": \"%s\", \"bytes\": %d, "
+	     "\"ops_per_sec\": %.1f, \"cycles_per_op\": %.1f, \"cycles_per_byte\": %.3f}\n",
+	     primitive, implementation, n_bytes,
+	     ops_per_sec, cycles_per_op, n_bytes > 0 ? cycles_per_op / n_bytes : 0);
+  else
+    fformat (stdout, "%s,%s,%d,%.1f,%.1f,%.3f\n",
+	     primitive, implementation, n_bytes,
+	     ops_per_sec, cycles_per_op, n_bytes > 0 ? cycles_per_op / n_bytes : 0);
+}
+
+static void bench_stream_xor (asnbench_crypto_main_t * bm, uword n_bytes)
+{ crypto_stream_xor (bm->cipher_text, bm->clear_text, n_bytes, bm->nonce, bm->key); }
+
+static void bench_onetimeauth (asnbench_crypto_main_t * bm, uword n_bytes)
+{ crypto_onetimeauth (bm->authentication, bm->clear_text, n_bytes, bm->key); }
+
+/* Clear text starts with crypto_box_reserved_pad_bytes of zeros. */
+static void bench_box_afternm (asnbench_crypto_main_t * bm, uword n_bytes)
+{ crypto_box_afternm (bm->cipher_text, bm->clear_text, crypto_box_reserved_pad_bytes + n_bytes, bm->nonce, bm->key); }
+
+static void bench_box_open_afternm (asnbench_crypto_main_t * bm, uword n_bytes)
+{
+  u8 * m = bm->clear_text + crypto_box_reserved_pad_bytes + (64 << 10);
+  if (crypto_box_open_afternm (m, bm->cipher_text, crypto_box_reserved_pad_bytes + n_bytes, bm->nonce, bm->key) < 0)
+    clib_warning ("open fails");
+}
+
+static void bench_box_detached_afternm (asnbench_crypto_main_t * bm, uword n_bytes)
+{ crypto_box_detached_afternm (bm->cipher_text, bm->authentication, bm->clear_text, n_bytes, bm->nonce, bm->key); }
+
+static void bench_hash (asnbench_crypto_main_t * bm, uword n_bytes)
+{ crypto_hash (bm->cipher_text, bm->clear_text, n_bytes); }
+
+static void bench_box_beforenm (asnbench_crypto_main_t * bm, uword n_bytes)
+{ crypto_box_beforenm (bm->key, bm->box_public, bm->box_private); }
+
+static void bench_sign_keypair (asnbench_crypto_main_t * bm, uword n_bytes)
+{ crypto_sign_keypair (bm->sign_public, bm->sign_private, /* want_random */ 0); }
+
+static void bench_sign (asnbench_crypto_main_t * bm, uword n_bytes)
+{
+  crypto_sign (bm->signed_message, &bm->n_signed_message_bytes,
+	       bm->box_public, sizeof (bm->box_public), bm->sign_private);
+}
+
+static void bench_sign_open (asnbench_crypto_main_t * bm, uword n_bytes)
+{
+  u64 l;
+  if (crypto_sign_open (bm->cipher_text, &l, bm->signed_message, bm->n_signed_message_bytes, bm->sign_public) < 0)
+    clib_warning ("sign open fails");
+}
+
+static void bench_random_bytes (asnbench_crypto_main_t * bm, uword n_bytes)
+{ crypto_random_bytes (bm->nonce, sizeof (bm->nonce)); }
+
+static void
+asnbench_crypto_sizes_run (asnbench_crypto_main_t * bm, char * primitive, char * implementation,
+			   asnbench_crypto_function_t * f)
+{
+  uword i;
+  for (i = 0; i < ARRAY_LEN (asnbench_crypto_sizes); i++)
+    asnbench_crypto_run (bm, primitive, implementation, f, asnbench_crypto_sizes[i]);
+}
+
+int asnbench_crypto_main (unformat_input_t * input)
+{
+  asnbench_crypto_main_t _bm, * bm = &_bm;
+  clib_error_t * error = 0;
+  uword i;
+
+  memset (bm, 0, sizeof (bm[0]));
+  bm->min_time = .1;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "time %f", &bm->min_time))
+	;
+      else if (unformat (input, "json"))
+	bm->is_json = 1;
+      else
+	{
+	  error = clib_error_return (0, "parse error: `%U'", format_unformat_error, input);
+	  goto done;
+	}
+    }
+
+  /* Room for reserved pad, largest size and a second buffer for open. */
+  vec_resize (bm->clear_text, 2 * (crypto_box_reserved_pad_bytes + (64 << 10)));
+  vec_resize (bm->cipher_text, crypto_box_reserved_pad_bytes + (64 << 10));
+  for (i = 0; i < vec_len (bm->clear_text); i++)
+    bm->clear_text[i] = i < crypto_box_reserved_pad_bytes ? 0 : i;
+  crypto_random_bytes (bm->key, sizeof (bm->key));
+  crypto_random_bytes (bm->nonce, sizeof (bm->nonce));
+  crypto_box_keypair (bm->box_public, bm->box_private, /* want_random */ 1);
+  crypto_sign_keypair (bm->sign_public, bm->sign_private, /* want_random */ 1);
+  crypto_sign (bm->signed_message, &bm->n_signed_message_bytes,
+	       bm->box_public, sizeof (bm->box_public), bm->sign_private);
+
+  if (! bm->is_json)
+    fformat (stdout, "primitive,implementation,bytes,ops_per_sec,cycles_per_op,cycles_per_byte\n");
+
+  {
+    static char * names[] = {
+      [CRYPTO_STREAM_SALSA20_IMPLEMENTATION_reference] = "reference",
+      [CRYPTO_STREAM_SALSA20_IMPLEMENTATION_sse2] = "sse2",
+      [CRYPTO_STREAM_SALSA20_IMPLEMENTATION_avx2] = "avx2",
+    };
+    for (i = CRYPTO_STREAM_SALSA20_IMPLEMENTATION_reference; i < ARRAY_LEN (names); i++)
+      if (crypto_stream_salsa20_select_implementation (i) >= 0)
+	asnbench_crypto_sizes_run (bm, "stream_xor", names[i], bench_stream_xor);
+    crypto_stream_salsa20_select_implementation (CRYPTO_STREAM_SALSA20_IMPLEMENTATION_default);
+  }
+
+  {
+    static char * names[] = {
+      [CRYPTO_ONETIMEAUTH_IMPLEMENTATION_reference] = "reference",
+      [CRYPTO_ONETIMEAUTH_IMPLEMENTATION_donna64] = "donna64",
+    };
+    for (i = CRYPTO_ONETIMEAUTH_IMPLEMENTATION_reference; i < ARRAY_LEN (names); i++)
+      if (crypto_onetimeauth_select_implementation (i) >= 0)
+	asnbench_crypto_sizes_run (bm, "onetimeauth", names[i], bench_onetimeauth);
+    crypto_onetimeauth_select_implementation (CRYPTO_ONETIMEAUTH_IMPLEMENTATION_default);
+  }
+
+  asnbench_crypto_sizes_run (bm, "box_afternm", "default", bench_box_afternm);
+
+  /* Open needs valid cipher text of each size. */
+  for (i = 0; i < ARRAY_LEN (asnbench_crypto_sizes); i++)
+    {
+      bench_box_afternm (bm, asnbench_crypto_sizes[i]);
+      asnbench_crypto_run (bm, "box_open_afternm", "default", bench_box_open_afternm, asnbench_crypto_sizes[i]);
+    }
+
+  asnbench_crypto_sizes_run (bm, "box_detached_afternm", "default", bench_box_detached_afternm);
+
+  {
+    static char * names[] = {
+      [CRYPTO_HASH_IMPLEMENTATION_reference] = "uclib",
+      [CRYPTO_HASH_IMPLEMENTATION_unrolled] = "unrolled",
+    };
+    for (i = CRYPTO_HASH_IMPLEMENTATION_reference; i < ARRAY_LEN (names); i++)
+      if (crypto_hash_select_implementation (i) >= 0)
+	asnbench_crypto_sizes_run (bm, "hash", names[i], bench_hash);
+    crypto_hash_select_implementation (CRYPTO_HASH_IMPLEMENTATION_default);
+  }
+
+  {
+    static char * names[] = {
+      [CRYPTO_SCALARMULT_IMPLEMENTATION_reference] = "reference",
+      [CRYPTO_SCALARMULT_IMPLEMENTATION_fe51] = "fe51",
+    };
+    for (i = CRYPTO_SCALARMULT_IMPLEMENTATION_reference; i < ARRAY_LEN (names); i++)
+      if (crypto_scalarmult_select_implementation (i) >= 0)
+	asnbench_crypto_run (bm, "box_beforenm", names[i], bench_box_beforenm, 0);
+    crypto_scalarmult_select_implementation (CRYPTO_SCALARMULT_IMPLEMENTATION_default);
+  }
+
+  {
+    static char * names[] = {
+      [CRYPTO_SIGN_IMPLEMENTATION_reference] = "reference",
+      [CRYPTO_SIGN_IMPLEMENTATION_table] = "table",
+    };
+    for (i = CRYPTO_SIGN_IMPLEMENTATION_reference; i < ARRAY_LEN (names); i++)
+      if (crypto_sign_select_implementation (i) >= 0)
+	{
+	  asnbench_crypto_run (bm, "sign_keypair", names[i], bench_sign_keypair, 0);
+	  asnbench_crypto_run (bm, "sign", names[i], bench_sign, 0);
+	}
+    crypto_sign_select_implementation (CRYPTO_SIGN_IMPLEMENTATION_default);
+  }
+
+  asnbench_crypto_run (bm, "sign_open", "default", bench_sign_open, 0);
+  asnbench_crypto_run (bm, "random_bytes", "default", bench_random_bytes, 0);
+
+ done:
+  vec_free (bm->clear_text);
+  vec_free (bm->cipher_text);
+  if (error)
+    clib_error_report (error);
+  return error ? 1 : 0;
+}
+
+int main (int argc, char * argv[])
+{
+  unformat_input_t i;
+  int ret;
+
+  unformat_init_command_line (&i, argv);
+  ret = asnbench_crypto_main (&i);
+  unformat_free (&i);
+
+  return ret;
+}
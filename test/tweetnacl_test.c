@@ -0,0 +1,675 @@
+#include <uclib/uclib.h>
+#include <casn/tweetnacl.h>
+#include <sys/wait.h>
+
+/* Cross checks of optimized crypto against tweetnacl reference code. */
+
+typedef struct {
+  u32 seed;
+  u32 n_iterations;
+  u32 verbose;
+} test_tweetnacl_main_t;
+
+static u32 test_random (test_tweetnacl_main_t * tm)
+{
+  tm->seed = 1664525 * tm->seed + 1013904223;
+  return tm->seed >> 8;
+}
+
+static void test_random_bytes (test_tweetnacl_main_t * tm, u8 * b, uword n_bytes)
+{
+  uword i;
+  for (i = 0; i < n_bytes; i++)
+    b[i] = test_random (tm);
+}
+
+static char * salsa20_implementation_names[] = {
+  [CRYPTO_STREAM_SALSA20_IMPLEMENTATION_reference] = "reference",
+  [CRYPTO_STREAM_SALSA20_IMPLEMENTATION_sse2] = "sse2",
+  [CRYPTO_STREAM_SALSA20_IMPLEMENTATION_avx2] = "avx2",
+};
+
+static clib_error_t * test_salsa20 (test_tweetnacl_main_t * tm)
+{
+  /* xsalsa20 test vector from NaCl (tests/stream3.c). */
+  static u8 key[32] = {
+    0x1b,0x27,0x55,0x64,0x73,0xe9,0x85,0xd4,0x62,0xcd,0x51,0x19,0x7a,0x9a,0x46,0xc7,
+    0x60,0x09,0x54,0x9e,0xac,0x64,0x74,0xf2,0x06,0xc4,0xee,0x08,0x44,0xf6,0x83,0x89,
+  };
+  static u8 nonce[24] = {
+    0x69,0x69,0x6e,0xe9,0x55,0xb6,0x2b,0x73,0xcd,0x62,0xbd,0xa8,0x75,0xfc,0x73,0xd6,
+    0x82,0x19,0xe0,0x03,0x6b,0x7a,0x0b,0x37,
+  };
+  static u8 expect[32] = {
+    0xee,0xa6,0xa7,0x25,0x1c,0x1e,0x72,0x91,0x6d,0x11,0xc2,0xcb,0x21,0x4d,0x3c,0x25,
+    0x25,0x39,0x12,0x1d,0x8e,0x23,0x4e,0x65,0x2d,0x65,0x1f,0xa4,0xc8,0xcf,0xf8,0x80,
+  };
+  clib_error_t * error = 0;
+  u8 k[32], n[8], * m = 0, * ref = 0, * c = 0, out[32];
+  uword i, impl, l;
+
+  /* Up to 32 blocks plus partial block. */
+  vec_resize (m, 33*64);
+  vec_resize (ref, 33*64);
+  vec_resize (c, 33*64);
+
+  for (impl = CRYPTO_STREAM_SALSA20_IMPLEMENTATION_reference;
+       impl <= CRYPTO_STREAM_SALSA20_IMPLEMENTATION_avx2;
+       impl++)
+    {
+      if (crypto_stream_salsa20_select_implementation (impl) < 0)
+	{
+	  if (tm->verbose)
+	    clib_warning ("salsa20 %s: not supported by cpu", salsa20_implementation_names[impl]);
+	  continue;
+	}
+
+      crypto_stream (out, sizeof (out), nonce, key);
+      if (memcmp (out, expect, sizeof (expect)))
+	{
+	  error = clib_error_return (0, "salsa20 %s: test vector mismatch %U",
+				     salsa20_implementation_names[impl],
+				     format_hex_bytes, out, sizeof (out));
+	  goto done;
+	}
+
+      for (i = 0; i < tm->n_iterations; i++)
+	{
+	  test_random_bytes (tm, k, sizeof (k));
+	  test_random_bytes (tm, n, sizeof (n));
+	  l = test_random (tm) % vec_len (m);
+	  test_random_bytes (tm, m, l);
+
+	  crypto_stream_salsa20_select_implementation (CRYPTO_STREAM_SALSA20_IMPLEMENTATION_reference);
+	  crypto_stream_salsa20_xor (ref, m, l, n, k);
+
+	  crypto_stream_salsa20_select_implementation (impl);
+	  crypto_stream_salsa20_xor (c, m, l, n, k);
+	  if (memcmp (c, ref, l))
+	    {
+	      error = clib_error_return (0, "salsa20 %s: xor mismatch %d bytes", salsa20_implementation_names[impl], l);
+	      goto done;
+	    }
+
+	  /* In place. */
+	  memcpy (c, m, l);
+	  crypto_stream_salsa20_xor (c, c, l, n, k);
+	  if (memcmp (c, ref, l))
+	    {
+	      error = clib_error_return (0, "salsa20 %s: in place mismatch %d bytes", salsa20_implementation_names[impl], l);
+	      goto done;
+	    }
+	}
+
+      if (tm->verbose)
+	clib_warning ("salsa20 %s: ok", salsa20_implementation_names[impl]);
+    }
+
+ done:
+  crypto_stream_salsa20_select_implementation (CRYPTO_STREAM_SALSA20_IMPLEMENTATION_default);
+  vec_free (m);
+  vec_free (ref);
+  vec_free (c);
+  return error;
+}
+
+static char * onetimeauth_implementation_names[] = {
+  [CRYPTO_ONETIMEAUTH_IMPLEMENTATION_reference] = "reference",
+  [CRYPTO_ONETIMEAUTH_IMPLEMENTATION_donna64] = "donna64",
+};
+
+static clib_error_t * test_poly1305 (test_tweetnacl_main_t * tm)
+{
+  /* Test vector from RFC 7539 section 2.5.2. */
+  static u8 key[32] = {
+    0x85,0xd6,0xbe,0x78,0x57,0x55,0x6d,0x33,0x7f,0x44,0x52,0xfe,0x42,0xd5,0x06,0xa8,
+    0x01,0x03,0x80,0x8a,0xfb,0x0d,0xb2,0xfd,0x4a,0xbf,0xf6,0xaf,0x41,0x49,0xf5,0x1b,
+  };
+  static char msg[] = "Cryptographic Forum Research Group";
+  static u8 expect[16] = {
+    0xa8,0x06,0x1d,0xc1,0x30,0x51,0x36,0xc6,0xc2,0x2b,0x8b,0xaf,0x0c,0x01,0x27,0xa9,
+  };
+  clib_error_t * error = 0;
+  u8 k[32], * m = 0, ref[16], a[16];
+  uword i, impl, l;
+
+  vec_resize (m, 2048);
+
+  for (impl = CRYPTO_ONETIMEAUTH_IMPLEMENTATION_reference;
+       impl <= CRYPTO_ONETIMEAUTH_IMPLEMENTATION_donna64;
+       impl++)
+    {
+      if (crypto_onetimeauth_select_implementation (impl) < 0)
+	{
+	  if (tm->verbose)
+	    clib_warning ("poly1305 %s: not supported", onetimeauth_implementation_names[impl]);
+	  continue;
+	}
+
+      crypto_onetimeauth (a, (u8 *) msg, strlen (msg), key);
+      if (memcmp (a, expect, sizeof (expect)))
+	{
+	  error = clib_error_return (0, "poly1305 %s: test vector mismatch %U",
+				     onetimeauth_implementation_names[impl],
+				     format_hex_bytes, a, sizeof (a));
+	  goto done;
+	}
+
+      for (i = 0; i < tm->n_iterations; i++)
+	{
+	  l = test_random (tm) % vec_len (m);
+
+	  /* Every 4th iteration use all ones key and data to exercise carries. */
+	  if (i % 4 == 3)
+	    {
+	      memset (k, 0xff, sizeof (k));
+	      memset (m, 0xff, l);
+	    }
+	  else
+	    {
+	      test_random_bytes (tm, k, sizeof (k));
+	      test_random_bytes (tm, m, l);
+	    }
+
+	  crypto_onetimeauth_select_implementation (CRYPTO_ONETIMEAUTH_IMPLEMENTATION_reference);
+	  crypto_onetimeauth (ref, m, l, k);
+
+	  crypto_onetimeauth_select_implementation (impl);
+	  crypto_onetimeauth (a, m, l, k);
+	  if (memcmp (a, ref, sizeof (ref)))
+	    {
+	      error = clib_error_return (0, "poly1305 %s: mismatch %d bytes", onetimeauth_implementation_names[impl], l);
+	      goto done;
+	    }
+
+	  if (crypto_onetimeauth_verify (ref, m, l, k) != 0)
+	    {
+	      error = clib_error_return (0, "poly1305 %s: verify fails %d bytes", onetimeauth_implementation_names[impl], l);
+	      goto done;
+	    }
+
+	  ref[i % sizeof (ref)] ^= 1 << (i % 8);
+	  if (crypto_onetimeauth_verify (ref, m, l, k) == 0)
+	    {
+	      error = clib_error_return (0, "poly1305 %s: verify accepts bad authenticator", onetimeauth_implementation_names[impl]);
+	      goto done;
+	    }
+	}
+
+      if (tm->verbose)
+	clib_warning ("poly1305 %s: ok", onetimeauth_implementation_names[impl]);
+    }
+
+ done:
+  crypto_onetimeauth_select_implementation (CRYPTO_ONETIMEAUTH_IMPLEMENTATION_default);
+  vec_free (m);
+  return error;
+}
+
+/* Detached box must give same cipher text and authenticator as padded box. */
+static clib_error_t * test_box_detached (test_tweetnacl_main_t * tm)
+{
+  clib_error_t * error = 0;
+  u8 k[32], n[24], a[16], * m = 0, * ref = 0, * c = 0;
+  uword i, l;
+
+  vec_resize (m, 32 + 5000);
+  vec_resize (ref, 32 + 5000);
+  vec_resize (c, 5000);
+
+  for (i = 0; i < tm->n_iterations; i++)
+    {
+      test_random_bytes (tm, k, sizeof (k));
+      test_random_bytes (tm, n, sizeof (n));
+      l = test_random (tm) % (vec_len (m) - 32);
+      memset (m, 0, 32);
+      test_random_bytes (tm, m + 32, l);
+
+      crypto_box_afternm (ref, m, 32 + l, n, k);
+
+      crypto_box_detached_afternm (c, a, m + 32, l, n, k);
+      if (memcmp (c, ref + 32, l) || memcmp (a, ref + 16, sizeof (a)))
+	{
+	  error = clib_error_return (0, "box detached: mismatch %d bytes", l);
+	  goto done;
+	}
+
+      /* In place. */
+      memcpy (c, m + 32, l);
+      crypto_box_detached_afternm (c, a, c, l, n, k);
+      if (memcmp (c, ref + 32, l) || memcmp (a, ref + 16, sizeof (a)))
+	{
+	  error = clib_error_return (0, "box detached: in place mismatch %d bytes", l);
+	  goto done;
+	}
+
+      if (crypto_box_open_detached_afternm (c, c, a, l, n, k) < 0
+	  || memcmp (c, m + 32, l))
+	{
+	  error = clib_error_return (0, "box open detached: fails %d bytes", l);
+	  goto done;
+	}
+
+      memcpy (c, ref + 32, l);
+      a[i % sizeof (a)] ^= 1 << (i % 8);
+      if (crypto_box_open_detached_afternm (c, c, a, l, n, k) == 0)
+	{
+	  error = clib_error_return (0, "box open detached: accepts bad authenticator");
+	  goto done;
+	}
+    }
+
+  if (tm->verbose)
+    clib_warning ("box detached: ok");
+
+ done:
+  vec_free (m);
+  vec_free (ref);
+  vec_free (c);
+  return error;
+}
+
+static char * scalarmult_implementation_names[] = {
+  [CRYPTO_SCALARMULT_IMPLEMENTATION_reference] = "reference",
+  [CRYPTO_SCALARMULT_IMPLEMENTATION_fe51] = "fe51",
+};
+
+static clib_error_t * test_scalarmult (test_tweetnacl_main_t * tm)
+{
+  /* Test vector from RFC 7748 section 5.2. */
+  static u8 scalar[32] = {
+    0xa5,0x46,0xe3,0x6b,0xf0,0x52,0x7c,0x9d,0x3b,0x16,0x15,0x4b,0x82,0x46,0x5e,0xdd,
+    0x62,0x14,0x4c,0x0a,0xc1,0xfc,0x5a,0x18,0x50,0x6a,0x22,0x44,0xba,0x44,0x9a,0xc4,
+  };
+  static u8 point[32] = {
+    0xe6,0xdb,0x68,0x67,0x58,0x30,0x30,0xdb,0x35,0x94,0xc1,0xa4,0x24,0xb1,0x5f,0x7c,
+    0x72,0x66,0x24,0xec,0x26,0xb3,0x35,0x3b,0x10,0xa9,0x03,0xa6,0xd0,0xab,0x1c,0x4c,
+  };
+  static u8 expect[32] = {
+    0xc3,0xda,0x55,0x37,0x9d,0xe9,0xc6,0x90,0x8e,0x94,0xea,0x4d,0xf2,0x8d,0x08,0x4f,
+    0x32,0xec,0xcf,0x03,0x49,0x1c,0x71,0xf7,0x54,0xb4,0x07,0x55,0x77,0xa2,0x85,0x52,
+  };
+  clib_error_t * error = 0;
+  u8 n[32], p[32], ref[32], q[32];
+  uword i, impl;
+
+  for (impl = CRYPTO_SCALARMULT_IMPLEMENTATION_reference;
+       impl <= CRYPTO_SCALARMULT_IMPLEMENTATION_fe51;
+       impl++)
+    {
+      if (crypto_scalarmult_select_implementation (impl) < 0)
+	{
+	  if (tm->verbose)
+	    clib_warning ("scalarmult %s: not supported", scalarmult_implementation_names[impl]);
+	  continue;
+	}
+
+      crypto_scalarmult (q, scalar, point);
+      if (memcmp (q, expect, sizeof (expect)))
+	{
+	  error = clib_error_return (0, "scalarmult %s: test vector mismatch %U",
+				     scalarmult_implementation_names[impl],
+				     format_hex_bytes, q, sizeof (q));
+	  goto done;
+	}
+
+      /* Reference is slow so use fewer iterations. */
+      for (i = 0; i < tm->n_iterations / 10; i++)
+	{
+	  test_random_bytes (tm, n, sizeof (n));
+
+	  /* Every 4th iteration use point with all bits set: not reduced mod p. */
+	  if (i % 4 == 3)
+	    memset (p, 0xff, sizeof (p));
+	  else
+	    test_random_bytes (tm, p, sizeof (p));
+
+	  crypto_scalarmult_select_implementation (CRYPTO_SCALARMULT_IMPLEMENTATION_reference);
+	  crypto_scalarmult (ref, n, p);
+
+	  crypto_scalarmult_select_implementation (impl);
+	  crypto_scalarmult (q, n, p);
+	  if (memcmp (q, ref, sizeof (ref)))
+	    {
+	      error = clib_error_return (0, "scalarmult %s: mismatch scalar %U point %U",
+					 scalarmult_implementation_names[impl],
+					 format_hex_bytes, n, sizeof (n),
+					 format_hex_bytes, p, sizeof (p));
+	      goto done;
+	    }
+	}
+
+      if (tm->verbose)
+	clib_warning ("scalarmult %s: ok", scalarmult_implementation_names[impl]);
+    }
+
+ done:
+  crypto_scalarmult_select_implementation (CRYPTO_SCALARMULT_IMPLEMENTATION_default);
+  return error;
+}
+
+static char * hash_implementation_names[] = {
+  [CRYPTO_HASH_IMPLEMENTATION_reference] = "reference",
+  [CRYPTO_HASH_IMPLEMENTATION_unrolled] = "unrolled",
+};
+
+static clib_error_t * test_sha512 (test_tweetnacl_main_t * tm)
+{
+  /* FIPS 180-2 "abc" test vector. */
+  static u8 expect[64] = {
+    0xdd,0xaf,0x35,0xa1,0x93,0x61,0x7a,0xba,0xcc,0x41,0x73,0x49,0xae,0x20,0x41,0x31,
+    0x12,0xe6,0xfa,0x4e,0x89,0xa9,0x7e,0xa2,0x0a,0x9e,0xee,0xe6,0x4b,0x55,0xd3,0x9a,
+    0x21,0x92,0x99,0x2a,0x27,0x4f,0xc1,0xa8,0x36,0xba,0x3c,0x23,0xa3,0xfe,0xeb,0xbd,
+    0x45,0x4d,0x44,0x23,0x64,0x3c,0xe8,0x0e,0x2a,0x9a,0xc9,0x4f,0xa5,0x4c,0xa4,0x9f,
+  };
+  clib_error_t * error = 0;
+  u8 * m = 0, ref[64], h[64];
+  uword i, impl, l;
+
+  vec_resize (m, 1024);
+
+  for (impl = CRYPTO_HASH_IMPLEMENTATION_reference;
+       impl <= CRYPTO_HASH_IMPLEMENTATION_unrolled;
+       impl++)
+    {
+      crypto_hash_select_implementation (impl);
+
+      crypto_hash (h, (u8 *) "abc", 3);
+      if (memcmp (h, expect, sizeof (expect)))
+	{
+	  error = clib_error_return (0, "sha512 %s: test vector mismatch %U",
+				     hash_implementation_names[impl],
+				     format_hex_bytes, h, sizeof (h));
+	  goto done;
+	}
+
+      for (i = 0; i < tm->n_iterations; i++)
+	{
+	  /* Cover all lengths around padding boundaries. */
+	  l = i < 260 ? i : test_random (tm) % vec_len (m);
+	  test_random_bytes (tm, m, l);
+
+	  crypto_hash_select_implementation (CRYPTO_HASH_IMPLEMENTATION_reference);
+	  crypto_hash (ref, m, l);
+
+	  crypto_hash_select_implementation (impl);
+	  crypto_hash (h, m, l);
+	  if (memcmp (h, ref, sizeof (ref)))
+	    {
+	      error = clib_error_return (0, "sha512 %s: mismatch %d bytes", hash_implementation_names[impl], l);
+	      goto done;
+	    }
+	}
+
+      if (tm->verbose)
+	clib_warning ("sha512 %s: ok", hash_implementation_names[impl]);
+    }
+
+ done:
+  crypto_hash_select_implementation (CRYPTO_HASH_IMPLEMENTATION_default);
+  vec_free (m);
+  return error;
+}
+
+static char * sign_implementation_names[] = {
+  [CRYPTO_SIGN_IMPLEMENTATION_reference] = "reference",
+  [CRYPTO_SIGN_IMPLEMENTATION_table] = "table",
+};
+
+static clib_error_t * test_sign (test_tweetnacl_main_t * tm)
+{
+  /* Test 1 from RFC 8032 section 7.1: empty message. */
+  static u8 secret[32] = {
+    0x9d,0x61,0xb1,0x9d,0xef,0xfd,0x5a,0x60,0xba,0x84,0x4a,0xf4,0x92,0xec,0x2c,0xc4,
+    0x44,0x49,0xc5,0x69,0x7b,0x32,0x69,0x19,0x70,0x3b,0xac,0x03,0x1c,0xae,0x7f,0x60,
+  };
+  static u8 expect_public[32] = {
+    0xd7,0x5a,0x98,0x01,0x82,0xb1,0x0a,0xb7,0xd5,0x4b,0xfe,0xd3,0xc9,0x64,0x07,0x3a,
+    0x0e,0xe1,0x72,0xf3,0xda,0xa6,0x23,0x25,0xaf,0x02,0x1a,0x68,0xf7,0x07,0x51,0x1a,
+  };
+  static u8 expect_signature[64] = {
+    0xe5,0x56,0x43,0x00,0xc3,0x60,0xac,0x72,0x90,0x86,0xe2,0xcc,0x80,0x6e,0x82,0x8a,
+    0x84,0x87,0x7f,0x1e,0xb8,0xe5,0xd9,0x74,0xd8,0x73,0xe0,0x65,0x22,0x49,0x01,0x55,
+    0x5f,0xb8,0x82,0x15,0x90,0xa3,0x3b,0xac,0xc6,0x1e,0x39,0x70,0x1c,0xf9,0xb4,0x6b,
+    0xd2,0x5b,0xf5,0xf0,0x59,0x5b,0xbe,0x24,0x65,0x51,0x41,0x43,0x8e,0x7a,0x10,0x0b,
+  };
+  clib_error_t * error = 0;
+  u8 pk[2][crypto_sign_public_key_bytes], sk[2][crypto_sign_private_key_bytes];
+  u8 m[64], sm[2][crypto_sign_signature_bytes + sizeof (m)];
+  u64 l, sml;
+  uword i, impl;
+
+  for (impl = CRYPTO_SIGN_IMPLEMENTATION_reference;
+       impl <= CRYPTO_SIGN_IMPLEMENTATION_table;
+       impl++)
+    {
+      crypto_sign_select_implementation (impl);
+
+      memcpy (sk[0], secret, sizeof (secret));
+      crypto_sign_keypair (pk[0], sk[0], /* want_random */ 0);
+      crypto_sign (sm[0], &sml, m, 0, sk[0]);
+      if (memcmp (pk[0], expect_public, sizeof (expect_public))
+	  || memcmp (sm[0], expect_signature, sizeof (expect_signature)))
+	{
+	  error = clib_error_return (0, "sign %s: test vector mismatch %U",
+				     sign_implementation_names[impl],
+				     format_hex_bytes, sm[0], sizeof (expect_signature));
+	  goto done;
+	}
+
+      /* Reference is slow so use fewer iterations. */
+      for (i = 0; i < tm->n_iterations / 10; i++)
+	{
+	  test_random_bytes (tm, sk[0], 32);
+	  memcpy (sk[1], sk[0], 32);
+	  l = test_random (tm) % sizeof (m);
+	  test_random_bytes (tm, m, l);
+
+	  crypto_sign_select_implementation (CRYPTO_SIGN_IMPLEMENTATION_reference);
+	  crypto_sign_keypair (pk[0], sk[0], /* want_random */ 0);
+	  crypto_sign (sm[0], &sml, m, l, sk[0]);
+
+	  crypto_sign_select_implementation (impl);
+	  crypto_sign_keypair (pk[1], sk[1], /* want_random */ 0);
+	  crypto_sign (sm[1], &sml, m, l, sk[1]);
+
+	  if (memcmp (pk[0], pk[1], sizeof (pk[0])) || memcmp (sm[0], sm[1], sml))
+	    {
+	      error = clib_error_return (0, "sign %s: mismatch %d bytes", sign_implementation_names[impl], l);
+	      goto done;
+	    }
+	}
+
+      if (tm->verbose)
+	clib_warning ("sign %s: ok", sign_implementation_names[impl]);
+    }
+
+ done:
+  crypto_sign_select_implementation (CRYPTO_SIGN_IMPLEMENTATION_default);
+  return error;
+}
+
+static clib_error_t * test_sign_batch (test_tweetnacl_main_t * tm)
+{
+  clib_error_t * error = 0;
+  u8 pk[64][crypto_sign_public_key_bytes], sk[crypto_sign_private_key_bytes];
+  u8 sm[64][crypto_sign_signature_bytes + 32 + 64];
+  const u8 * sms[64], * pks[64];
+  u64 sml[64];
+  int valid[64];
+  uword i, j, k, n, bad;
+
+  for (i = 0; i < ARRAY_LEN (sm); i++)
+    {
+      u8 m[32 + 64];
+      u64 l = test_random (tm) % sizeof (m);
+
+      test_random_bytes (tm, sk, 32);
+      crypto_sign_keypair (pk[i], sk, /* want_random */ 0);
+      test_random_bytes (tm, m, l);
+      crypto_sign (sm[i], &sml[i], m, l, sk);
+      sms[i] = sm[i];
+      pks[i] = pk[i];
+    }
+
+  for (i = 0; i < tm->n_iterations / 100; i++)
+    {
+      n = 1 + test_random (tm) % ARRAY_LEN (sm);
+
+      if (crypto_sign_verify_batch (valid, sms, sml, pks, n) != 0)
+	{
+	  error = clib_error_return (0, "sign batch: rejects %d good signatures", n);
+	  goto done;
+	}
+
+      /* Corrupt signature or message, batch must find it. */
+      bad = test_random (tm) % n;
+      k = test_random (tm) % sml[bad];
+      sm[bad][k] ^= 1 << (i % 8);
+      if (crypto_sign_verify_batch (valid, sms, sml, pks, n) == 0)
+	{
+	  error = clib_error_return (0, "sign batch: accepts bad signature %d of %d", bad, n);
+	  goto done;
+	}
+      for (j = 0; j < n; j++)
+	if (valid[j] != (j != bad))
+	  {
+	    error = clib_error_return (0, "sign batch: signature %d of %d marked %s",
+				       j, n, valid[j] ? "valid" : "invalid");
+	    goto done;
+	  }
+
+      sm[bad][k] ^= 1 << (i % 8);
+    }
+
+  if (tm->verbose)
+    clib_warning ("sign batch: ok");
+
+ done:
+  return error;
+}
+
+/* Generator output must not repeat, including across fork. */
+static clib_error_t * test_random_bytes_fork (test_tweetnacl_main_t * tm)
+{
+  clib_error_t * error = 0;
+  u8 a[32], b[32], c[32];
+  int p[2], status;
+  pid_t pid;
+
+  /* Leave buffered bytes for child to (wrongly) reuse. */
+  crypto_random_bytes (a, sizeof (a));
+  crypto_random_bytes (b, sizeof (b));
+  if (! memcmp (a, b, sizeof (a)))
+    return clib_error_return (0, "random bytes: repeat");
+
+  if (pipe (p) < 0)
+    return clib_error_return_unix (0, "pipe");
+
+  pid = fork ();
+  if (pid < 0)
+    {
+      error = clib_error_return_unix (0, "fork");
+      goto done;
+    }
+  if (pid == 0)
+    {
+      crypto_random_bytes (c, sizeof (c));
+      _exit (write (p[1], c, sizeof (c)) == sizeof (c) ? 0 : 1);
+    }
+
+  crypto_random_bytes (a, sizeof (a));
+  if (read (p[0], c, sizeof (c)) != sizeof (c)
+      || waitpid (pid, &status, 0) != pid || status != 0)
+    {
+      error = clib_error_return (0, "random bytes: child failed");
+      goto done;
+    }
+  if (! memcmp (a, c, sizeof (a)))
+    {
+      error = clib_error_return (0, "random bytes: parent and child repeat after fork");
+      goto done;
+    }
+
+  if (tm->verbose)
+    clib_warning ("random bytes: ok");
+
+ done:
+  close (p[0]);
+  close (p[1]);
+  return error;
+}
+
+int test_tweetnacl_main (unformat_input_t * input)
+{
+  test_tweetnacl_main_t _tm, * tm = &_tm;
+  clib_error_t * error = 0;
+
+  memset (tm, 0, sizeof (tm[0]));
+  tm->seed = 0x12345678;
+  tm->n_iterations = 1000;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "seed %d", &tm->seed))
+	;
+      else if (unformat (input, "iter %d", &tm->n_iterations))
+	;
+      else if (unformat (input, "verbose"))
+	tm->verbose = 1;
+      else
+	{
+	  error = clib_error_return (0, "parse error: `%U'", format_unformat_error, input);
+	  goto done;
+	}
+    }
+
+  error = test_random_bytes_fork (tm);
+  if (error)
+    goto done;
+
+  error = test_salsa20 (tm);
+  if (error)
+    goto done;
+
+  error = test_poly1305 (tm);
+  if (error)
+    goto done;
+
+  error = test_box_detached (tm);
+  if (error)
+    goto done;
+
+  error = test_scalarmult (tm);
+  if (error)
+    goto done;
+
+  error = test_sha512 (tm);
+  if (error)
+    goto done;
+
+  error = test_sign (tm);
+  if (error)
+    goto done;
+
+  error = test_sign_batch (tm);
+  if (error)
+    goto done;
+
+ done:
+  if (error)
+    clib_error_report (error);
+  return error ? 1 : 0;
+}
+
+int main (int argc, char * argv[])
+{
+  unformat_input_t i;
+  int ret;
+
+  unformat_init_command_line (&i, argv);
+  ret = test_tweetnacl_main (&i);
+  unformat_free (&i);
+
+  return ret;
+}